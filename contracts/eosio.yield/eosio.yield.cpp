@@ -6,6 +6,9 @@
 #include <eosio.evm/eosio.evm.hpp>
 #include <eosio.evm/silkworm.hpp>
 
+// fixed point math
+#include <eosio.yield/fixed_point.hpp>
+
 // core
 #include <eosio.yield/eosio.yield.hpp>
 
@@ -24,6 +27,7 @@ void yield::regprotocol( const name protocol, const name category, const map<nam
     require_auth( protocol );
 
     yield::protocols_table _protocols( get_self(), get_self().value );
+    yield::metadata_table _metadata( get_self(), get_self().value );
 
     // protocol must be smart contract that includes ABI
     check( is_contract( protocol ), "yield::regprotocol: [protocol] must be a smart contract");
@@ -37,6 +41,10 @@ void yield::regprotocol( const name protocol, const name category, const map<nam
         row.contracts.insert( protocol );
         row.balance.contract = config.rewards.get_contract();
         row.balance.quantity.symbol = config.rewards.get_symbol();
+        row.accrued.symbol = config.rewards.get_symbol();
+    };
+    auto insert_metadata = [&]( auto& row ) {
+        row.protocol = protocol;
         row.metadata = metadata;
         if ( !row.created_at.sec_since_epoch() ) row.created_at = current_time_point();
         row.updated_at = current_time_point();
@@ -48,6 +56,10 @@ void yield::regprotocol( const name protocol, const name category, const map<nam
     if ( is_exists ) _protocols.modify( itr, protocol, insert );
     else _protocols.emplace( protocol, insert );
 
+    auto metadata_itr = _metadata.find( protocol.value );
+    if ( metadata_itr != _metadata.end() ) _metadata.modify( metadata_itr, protocol, insert_metadata );
+    else _metadata.emplace( protocol, insert_metadata );
+
     // if denied revert back to pending
     if ( itr->status == "denied"_n ) set_status(protocol, "pending"_n);
 
@@ -66,9 +78,11 @@ void yield::setmetadata( const name protocol, const map<name, string> metadata )
     require_auth_admin( protocol );
 
     yield::protocols_table _protocols( get_self(), get_self().value );
+    yield::metadata_table _metadata( get_self(), get_self().value );
     auto & itr = _protocols.get( protocol.value, "yield::setmetadata: [protocol] does not exists");
+    auto & metadata_itr = _metadata.get( protocol.value, "yield::setmetadata: [protocol] does not exists");
 
-    _protocols.modify( itr, get_ram_payer(protocol), [&]( auto& row ) {
+    _metadata.modify( metadata_itr, get_ram_payer(protocol), [&]( auto& row ) {
         row.metadata = metadata;
         row.updated_at = current_time_point();
     });
@@ -88,9 +102,11 @@ void yield::setmetakey( const name protocol, const name key, const optional<stri
     require_auth_admin(protocol);
 
     yield::protocols_table _protocols( get_self(), get_self().value );
+    yield::metadata_table _metadata( get_self(), get_self().value );
     auto & itr = _protocols.get( protocol.value, "yield::setmetakey: [protocol] does not exists");
+    auto & metadata_itr = _metadata.get( protocol.value, "yield::setmetakey: [protocol] does not exists");
 
-    _protocols.modify( itr, get_ram_payer(protocol), [&]( auto& row ) {
+    _metadata.modify( metadata_itr, get_ram_payer(protocol), [&]( auto& row ) {
         if ( value ) row.metadata[key] = *value;
         else row.metadata.erase(key);
         row.updated_at = current_time_point();
@@ -101,7 +117,7 @@ void yield::setmetakey( const name protocol, const name key, const optional<stri
 
     // logging
     yield::metadatalog_action metadatalog( get_self(), { get_self(), "active"_n });
-    metadatalog.send( protocol, itr.status, itr.category, itr.metadata );
+    metadatalog.send( protocol, itr.status, itr.category, metadata_itr.metadata );
 }
 
 // @protocol
@@ -110,6 +126,9 @@ void yield::claim( const name protocol, const optional<name> receiver, const opt
 {
     require_auth_admin(protocol);
 
+    // settle rewards accrued during the current epoch
+    settle_rewards( protocol );
+
     yield::protocols_table _protocols( get_self(), get_self().value );
 
     if ( receiver ) check( is_account( *receiver ), "yield::claim: [receiver] does not exists");
@@ -134,6 +153,9 @@ void yield::claim( const name protocol, const optional<name> receiver, const opt
     // modify balances
     _protocols.modify( itr, same_payer, [&]( auto& row ) {
         row.balance.quantity.amount = 0;
+    });
+    yield::metadata_table _metadata( get_self(), get_self().value );
+    _metadata.modify( _metadata.get( protocol.value, "yield::claim: [protocol] does not exists"), same_payer, [&]( auto& row ) {
         row.claimed_at = current_time_point();
     });
 
@@ -174,8 +196,10 @@ void yield::set_category( const name protocol, const name category )
     if ( itr.status == "denied"_n ) set_status(protocol, "pending"_n);
 
     // logging
+    yield::metadata_table _metadata( get_self(), get_self().value );
+    const auto metadata = _metadata.get( protocol.value, "yield::set_category: [protocol] does not exists").metadata;
     yield::metadatalog_action metadatalog( get_self(), { get_self(), "active"_n });
-    metadatalog.send( protocol, itr.status, category, itr.metadata );
+    metadatalog.send( protocol, itr.status, category, metadata );
 }
 
 // @admin
@@ -226,6 +250,91 @@ void yield::setrate( const optional<int16_t> annual_rate, const optional<asset>
     _config.set(config, get_self());
 }
 
+// @system
+[[eosio::action]]
+void yield::setepoch( const uint32_t epoch_interval )
+{
+    require_auth( get_self() );
+
+    yield::config_table _config( get_self(), get_self().value );
+    check( _config.exists(), "yield::setepoch: contract must first call [init] action");
+    auto config = get_config();
+    check( config.epoch_interval.value() != epoch_interval, "yield::setepoch: [epoch_interval] was not modified");
+    check( epoch_interval <= YEAR, "yield::setepoch: [epoch_interval] cannot exceed 1 year");
+    config.epoch_interval = epoch_interval;
+    _config.set(config, get_self());
+}
+
+// @system
+[[eosio::action]]
+void yield::migrate( const optional<uint16_t> max_rows )
+{
+    require_auth( get_self() );
+
+    yield::legacy_protocols_table _legacy_protocols( get_self(), get_self().value );
+    yield::legacy_state_table _legacy_state( get_self(), get_self().value );
+    yield::protocols_table _protocols( get_self(), get_self().value );
+    yield::metadata_table _metadata( get_self(), get_self().value );
+    check( _legacy_protocols.begin() != _legacy_protocols.end() || _legacy_state.exists(), "yield::migrate: no legacy protocols to migrate");
+
+    int limit = max_rows ? *max_rows : 50;
+    check( limit, "yield::migrate: [max_rows] must be above 0");
+    const auto config = get_config();
+
+    auto itr = _legacy_protocols.begin();
+    while ( itr != _legacy_protocols.end() && limit-- > 0 ) {
+        const name protocol = itr->protocol;
+
+        // protocol registered again before migration keeps its new row
+        auto protocol_itr = _protocols.find( protocol.value );
+        if ( protocol_itr != _protocols.end() ) {
+            _protocols.modify( protocol_itr, same_payer, [&]( auto& row ) {
+                row.balance.quantity += itr->balance.quantity;
+            });
+        } else {
+            set<checksum160> evm_contracts;
+            for ( const string& evm_contract : itr->evm_contracts ) {
+                const optional<bytes> address = silkworm::from_hex( evm_contract );
+                check( address && address->size() == 20, "yield::migrate: [evm_contract=" + evm_contract + "] is not a valid address");
+                evm_contracts.insert( evm_contract::to_address( *address ) );
+            }
+            _protocols.emplace( get_self(), [&]( auto& row ) {
+                row.protocol = protocol;
+                row.status = itr->status;
+                row.category = itr->category;
+                row.contracts = itr->contracts;
+                row.evm_contracts = evm_contracts;
+                row.tvl = itr->tvl;
+                row.usd = itr->usd;
+                row.balance = itr->balance;
+                row.period_at = itr->period_at;
+                row.accrued.symbol = config.rewards.get_symbol();
+            });
+            if ( itr->status == "active"_n ) add_active_protocol( protocol );
+        }
+
+        // descriptive fields
+        if ( _metadata.find( protocol.value ) == _metadata.end() ) {
+            _metadata.emplace( get_self(), [&]( auto& row ) {
+                row.protocol = protocol;
+                row.metadata = itr->metadata;
+                row.created_at = itr->created_at;
+                row.updated_at = itr->updated_at;
+                row.claimed_at = itr->claimed_at;
+            });
+        }
+        itr = _legacy_protocols.erase( itr );
+    }
+
+    // legacy active protocols (removed once every protocol is moved)
+    if ( itr != _legacy_protocols.end() || !_legacy_state.exists() ) return;
+    for ( const name protocol : _legacy_state.get().active_protocols ) {
+        auto protocol_itr = _protocols.find( protocol.value );
+        if ( protocol_itr != _protocols.end() && protocol_itr->status == "active"_n ) add_active_protocol( protocol );
+    }
+    _legacy_state.remove();
+}
+
 // @system
 [[eosio::action]]
 void yield::init( const extended_symbol rewards, const name oracle_contract, const name admin_contract )
@@ -262,12 +371,19 @@ void yield::unregister( const name protocol )
 {
     require_auth_admin(protocol);
 
+    // settle rewards accrued during the current epoch (must be claimed before `unregister`)
+    settle_rewards( protocol );
+
     yield::protocols_table _protocols( get_self(), get_self().value );
     auto & itr = _protocols.get(protocol.value, "yield::unregister: [protocol] does not exists");
     check( itr.balance.quantity.amount == 0, "yield::unregister: protocol has " + itr.balance.quantity.to_string() + " remaining balance, must execute `claim` ACTION before `unregister`");
     _protocols.erase( itr );
     remove_active_protocol( protocol );
 
+    yield::metadata_table _metadata( get_self(), get_self().value );
+    auto metadata_itr = _metadata.find( protocol.value );
+    if ( metadata_itr != _metadata.end() ) _metadata.erase( metadata_itr );
+
     // logging
     yield::eraselog_action eraselog( get_self(), { get_self(), "active"_n });
     eraselog.send( protocol );
@@ -280,56 +396,123 @@ void yield::report( const name protocol, const time_point_sec period, const uint
     const auto config = get_config();
     require_auth(config.oracle_contract);
 
-    // tables
-    yield::protocols_table _protocols( get_self(), get_self().value );
+    check_report_period( config, period, period_interval );
+    add_report( config, { protocol, period, tvl, usd }, period_interval );
+}
 
+// @oracle.yield
+[[eosio::action]]
+void yield::reportbatch( const uint32_t period_interval, const vector<tvl_report> reports )
+{
+    const auto config = get_config();
+    require_auth(config.oracle_contract);
+    check( reports.size(), "yield::reportbatch: [reports] is empty");
+
+    // all reports must share the same period
+    const time_point_sec period = reports[0].period;
+    check_report_period( config, period, period_interval );
+
+    for ( const tvl_report& report : reports ) {
+        check( report.period == period, "yield::reportbatch: [period] must be the same for all reports");
+        add_report( config, report, period_interval );
+    }
+}
+
+// @oracle.yield
+[[eosio::action]]
+void yield::schedule( const time_point_sec period, const uint32_t period_interval, const vector<name> protocols )
+{
+    const auto config = get_config();
+    require_auth(config.oracle_contract);
+    check( protocols.size(), "yield::schedule: [protocols] is empty");
+    check( period <= current_time_point(), "yield::schedule: [period] cannot be in the future");
+
+    for ( const name protocol : protocols ) {
+        set_active_due( protocol, period + period_interval );
+    }
+}
+
+void yield::check_report_period( const config_row& config, const time_point_sec period, const uint32_t period_interval )
+{
     // config
     const time_point_sec now = current_time_point();
-    auto & itr = _protocols.get(protocol.value, "yield::report: [protocol] does not exists");
     check( config.min_tvl_report.amount, "yield::report: [min_tvl_report] not configured");
     check( config.max_tvl_report.amount, "yield::report: [max_tvl_report] not configured");
 
+    // period must be the current sampling period (reports are sent at the first sample after `period_interval`)
+    check( period <= now, "yield::report: [period] cannot be in the future");
+    check( period == get_current_period( PERIOD_INTERVAL ), "yield::report: [period] current period does not match");
+}
+
+void yield::add_report( const config_row& config, const tvl_report& report, const uint32_t period_interval )
+{
+    // tables
+    yield::protocols_table _protocols( get_self(), get_self().value );
+
+    const name protocol = report.protocol;
+    const time_point_sec period = report.period;
+    const asset tvl = report.tvl;
+    const asset usd = report.usd;
+    auto & itr = _protocols.get(protocol.value, "yield::report: [protocol] does not exists");
+
     // prevents double report
     check( itr.period_at != period, "yield::report: [period] already updated");
-    check( period <= now, "yield::report: [period] cannot be in the future");
     check( period > itr.period_at, "yield::report: [period] must be ahead of last");
-    check( period == get_current_period( period_interval ), "yield::report: [period] current period does not match");
 
     // validate TVL
     check( tvl.symbol == EOS, "yield::report: [tvl] does not match EOS symbol");
     check( usd.symbol == USD, "yield::report: [usd] does not match USD symbol");
 
-    // update protocol's TVL
-    _protocols.modify( itr, same_payer, [&]( auto& row ) {
-        row.tvl = tvl;
-        row.usd = usd;
-        row.period_at = period;
-        row.updated_at = current_time_point();
-    });
-
     // set to maximum value if exceeds max TVL value
     const int64_t tvl_amount = (tvl > config.max_tvl_report) ? config.max_tvl_report.amount : tvl.amount;
 
+    // rewards never cover more than the time elapsed since the last report (protocols sampled at different intervals)
+    const uint32_t rewards_interval = std::min<uint32_t>( period_interval, period.sec_since_epoch() - itr.period_at.sec_since_epoch() );
+
     // calculate rewards based on 5% APY
     // TVL * 5% / 365 days / 10 minute interval
-    int64_t rewards_amount = uint128_t(tvl_amount) * config.annual_rate * period_interval / 10000 / YEAR;
+    int64_t rewards_amount = ( fixed::decimal<PRECISION>::from_raw( tvl_amount ) * config.annual_rate * rewards_interval / 10000 / YEAR ).amount();
 
     // determine if project is eligible for rewards
     // set rewards to 0
     if ( tvl <= config.min_tvl_report ) rewards_amount = 0; // TVL must be above minimum TVL requirement
     if ( itr.status != "active"_n ) rewards_amount = 0; // protocol must be active to receive rewards (denied or pending)
 
-    // update rewards to protocol's balance
+    // rewards are accrued per epoch (if configured), rewards of a previous epoch are settled by the first report of the next one
     const asset rewards = { rewards_amount, config.rewards.get_symbol() };
-    if ( rewards.amount ) {
-        _protocols.modify( itr, same_payer, [&]( auto& row ) {
-            row.balance.quantity += rewards;
-        });
-
-        // log report
-        yield::rewardslog_action rewardslog( get_self(), { get_self(), "active"_n });
-        rewardslog.send( protocol, itr.category, period, period_interval, tvl, usd, rewards, itr.balance.quantity );
-    }
+    const uint32_t epoch_interval = config.epoch_interval.value();
+    const time_point_sec epoch = epoch_interval ? time_point_sec( period.sec_since_epoch() / epoch_interval * epoch_interval ) : period;
+    const bool is_settled = itr.accrued.amount && itr.epoch != epoch;
+    const time_point_sec settled_epoch = itr.epoch;
+    const uint32_t settled_interval = itr.accrued_interval;
+    const asset settled = itr.accrued;
+
+    // update protocol's TVL & rewards (single write per report)
+    // accrued rewards cannot be derived at settlement (reported TVL is not kept), they share the write of `tvl` & `period_at`
+    _protocols.modify( itr, same_payer, [&]( auto& row ) {
+        row.tvl = tvl;
+        row.usd = usd;
+        row.period_at = period;
+        if ( is_settled ) {
+            row.balance.quantity += row.accrued;
+            row.accrued.amount = 0;
+            row.accrued_interval = 0;
+        }
+        if ( !epoch_interval ) row.balance.quantity += rewards;
+        else if ( rewards.amount ) {
+            row.epoch = epoch;
+            row.accrued += rewards;
+            row.accrued_interval += rewards_interval;
+        }
+    });
+
+    // reschedule protocol to the next period
+    set_active_due( protocol, period + period_interval );
+
+    // log settled epoch & report rewards
+    yield::rewardslog_action rewardslog( get_self(), { get_self(), "active"_n });
+    if ( is_settled ) rewardslog.send( protocol, itr.category, settled_epoch, settled_interval, tvl, usd, settled, itr.balance.quantity );
+    if ( !epoch_interval && rewards.amount ) rewardslog.send( protocol, itr.category, period, rewards_interval, tvl, usd, rewards, itr.balance.quantity );
 }
 
 // @protocol or @admin
@@ -353,20 +536,24 @@ void yield::setcontracts( const name protocol, const set<name> contracts, const
     for ( const name contract : contracts ) {
         check( is_account( contract ), "yield::setcontracts: [contract=" + contract.to_string() + "] account does not exists");
     }
+    set<checksum160> evm_addresses;
     for ( const string evm_contract : evm_contracts ) {
-        check( evm_contract::is_account( *silkworm::from_hex(evm_contract) ), "yield::setcontracts: [evm_contract=" + evm_contract + "] account ID does not exists");
+        const optional<bytes> address = silkworm::from_hex(evm_contract);
+        check( address && address->size() == 20, "yield::setcontracts: [evm_contract=" + evm_contract + "] is not a valid address");
+        check( evm_contract::is_account( *address ), "yield::setcontracts: [evm_contract=" + evm_contract + "] account ID does not exists");
+        evm_addresses.insert( evm_contract::to_address( *address ) );
     }
 
     // modify contracts
     _protocols.modify( itr, get_ram_payer(protocol), [&]( auto& row ) {
         // prevent modification if no changes
         if ( contracts.size() ) check( row.contracts != contracts, "yield::setcontracts: [contracts] was not modified");
-        if ( evm_contracts.size() ) check( row.evm_contracts != evm_contracts, "yield::setcontracts: [evm_contracts] was not modified");
+        if ( evm_contracts.size() ) check( row.evm_contracts != evm_addresses, "yield::setcontracts: [evm_contracts] was not modified");
 
         row.contracts = contracts;
-        row.evm_contracts = evm_contracts;
-        row.updated_at = current_time_point();
+        row.evm_contracts = evm_addresses;
     });
+    set_updated_at( protocol );
 
     // protocol must be re-approved if `setcontracts` action is called
     set_status( protocol, "pending"_n );
@@ -377,6 +564,37 @@ void yield::setcontracts( const name protocol, const set<name> contracts, const
     contractslog.send( protocol, itr.status, itr.contracts, itr.evm_contracts );
 }
 
+void yield::set_updated_at( const name protocol )
+{
+    yield::metadata_table _metadata( get_self(), get_self().value );
+    auto & itr = _metadata.get( protocol.value, "yield::set_updated_at: [protocol] does not exists");
+    _metadata.modify( itr, get_ram_payer(protocol), [&]( auto& row ) {
+        row.updated_at = current_time_point();
+    });
+}
+
+void yield::settle_rewards( const name protocol )
+{
+    yield::protocols_table _protocols( get_self(), get_self().value );
+
+    auto itr = _protocols.find( protocol.value );
+    if ( itr == _protocols.end() || !itr->accrued.amount ) return;
+
+    // move accrued rewards to protocol's balance
+    const asset settled = itr->accrued;
+    const time_point_sec epoch = itr->epoch;
+    const uint32_t period_interval = itr->accrued_interval;
+    _protocols.modify( itr, same_payer, [&]( auto& row ) {
+        row.balance.quantity += row.accrued;
+        row.accrued.amount = 0;
+        row.accrued_interval = 0;
+    });
+
+    // log summarized epoch rewards
+    yield::rewardslog_action rewardslog( get_self(), { get_self(), "active"_n });
+    rewardslog.send( protocol, itr->category, epoch, period_interval, itr->tvl, itr->usd, settled, itr->balance.quantity );
+}
+
 void yield::transfer( const name from, const name to, const extended_asset value, const string& memo )
 {
     eosio::token::transfer_action transfer( value.contract, { from, "active"_n });
@@ -385,18 +603,32 @@ void yield::transfer( const name from, const name to, const extended_asset value
 
 void yield::add_active_protocol( const name protocol )
 {
-    yield::state_table _state( get_self(), get_self().value );
-    auto state = _state.get_or_default();
-    state.active_protocols.insert( protocol );
-    _state.set(state, get_self());
+    yield::active_table _active( get_self(), get_self().value );
+    if ( _active.find( protocol.value ) != _active.end() ) return; // already active
+
+    // due immediately (activation period starts the oracle failover grace window)
+    _active.emplace( get_self(), [&]( auto& row ) {
+        row.protocol = protocol;
+        row.due_at = get_current_period( PERIOD_INTERVAL );
+    });
 }
 
 void yield::remove_active_protocol( const name protocol )
 {
-    yield::state_table _state( get_self(), get_self().value );
-    auto state = _state.get_or_default();
-    state.active_protocols.erase( protocol );
-    _state.set(state, get_self());
+    yield::active_table _active( get_self(), get_self().value );
+    auto itr = _active.find( protocol.value );
+    if ( itr != _active.end() ) _active.erase( itr );
+}
+
+void yield::set_active_due( const name protocol, const time_point_sec due_at )
+{
+    yield::active_table _active( get_self(), get_self().value );
+    auto itr = _active.find( protocol.value );
+    if ( itr == _active.end() ) return; // protocol not active
+    if ( itr->due_at >= due_at ) return; // never moved back
+    _active.modify( itr, same_payer, [&]( auto& row ) {
+        row.due_at = due_at;
+    });
 }
 
 yield::config_row yield::get_config()
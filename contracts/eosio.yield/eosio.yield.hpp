@@ -28,6 +28,8 @@ public:
     const set<name> PROTOCOL_STATUS_TYPES = set<name>{"pending"_n, "active"_n, "denied"_n};
     const uint16_t MAX_ANNUAL_RATE = 1000; // maximum rate of 10%
     const uint32_t YEAR = 31536000; // 365 days in seconds
+    const uint32_t PERIOD_INTERVAL = 600; // 10 minutes (oracle sampling period)
+    static constexpr uint8_t PRECISION = 4;
     const uint16_t MAX_CONTRACTS = 10; // maximum 10 contracts per protocol (due to CPU limitations to compute TVL)
 
     // ERROR MESSAGES
@@ -36,12 +38,15 @@ public:
     /**
      * ## TABLE `config`
      *
+     * > `epoch_interval` is a binary extension (config written before it existed remains readable)
+     *
      * - `{uint16_t} annual_rate` - annual rate (pips 1/100 of 1%)
      * - `{asset} min_tvl_report` - minimum TVL report
      * - `{asset} max_tvl_report` - maximum TVL report
      * - `{extended_symbol} rewards` - rewards token
      * - `{name} oracle_contract` - Yield+ Oracle contract
      * - `{name} admin_contract` - Yield+ admin contract
+     * - `{uint32_t} epoch_interval=0` - rewards settlement epoch (in seconds, 0 = settle rewards at every report)
      *
      * ### example
      *
@@ -52,7 +57,8 @@ public:
      *     "max_tvl_report": "6000000.0000 EOS",
      *     "rewards": {"sym": "4,EOS", "contract": "eosio.token"},
      *     "oracle_contract": "oracle.yield",
-     *     "admin_contract": "admin.yield"
+     *     "admin_contract": "admin.yield",
+     *     "epoch_interval": 86400
      * }
      * ```
      */
@@ -63,29 +69,66 @@ public:
         extended_symbol         rewards;
         name                    oracle_contract = "oracle.yield"_n;
         name                    admin_contract = "admin.yield"_n;
+        binary_extension<uint32_t> epoch_interval = 0;
     };
     typedef eosio::singleton< "config"_n, config_row > config_table;
 
     /**
-     * ## TABLE `state`
+     * ## TABLE `active`
      *
-     * - `{set<name>} active_protocols` - array of active protocols
+     * > Active protocols scheduled for TVL updates, indexed by the next period due
+     *
+     * ### params
+     *
+     * - `{name} protocol` - (primary key) active protocol contract
+     * - `{time_point_sec} due_at` - next period due for TVL update (advanced on each report or sample without report)
+     *
+     * ### indexes
+     *
+     * - `{uint128_t} by.due` - (secondary key) `due_at` seconds (upper 64 bits) & `protocol` (lower 64 bits)
      *
      * ### example
      *
      * ```json
      * {
-     *     "active_protocols": ["myprotocol"]
+     *     "protocol": "myprotocol",
+     *     "due_at": "2022-05-13T00:10:00"
      * }
      * ```
      */
-    struct [[eosio::table("state")]] state_row {
-        set<name>           active_protocols;
+    struct [[eosio::table("active")]] active_row {
+        name                    protocol;
+        time_point_sec          due_at;
+
+        uint64_t primary_key() const { return protocol.value; }
+        uint128_t by_due() const { return get_due_key( due_at, protocol ); }
+    };
+    typedef eosio::multi_index< "active"_n, active_row,
+        indexed_by<"by.due"_n, const_mem_fun<active_row, uint128_t, &active_row::by_due>>
+    > active_table;
+
+    /**
+     * ## TABLE `state`
+     *
+     * > Legacy active protocols (read-only, moved to `active` & removed by `migrate`)
+     *
+     * - `{set<name>} active_protocols` - array of active protocols
+     */
+    struct [[eosio::table("state")]] legacy_state_row {
+        set<name>               active_protocols;
     };
-    typedef eosio::singleton< "state"_n, state_row > state_table;
+    typedef eosio::singleton< "state"_n, legacy_state_row > legacy_state_table;
+
+    // composite `by.due` key (due period & protocol)
+    static uint128_t get_due_key( const time_point_sec due_at, const name protocol )
+    {
+        return ( uint128_t{ due_at.sec_since_epoch() } << 64 ) | protocol.value;
+    }
 
     /**
-     * ## TABLE `protocols`
+     * ## TABLE `protocols.v2`
+     *
+     * > Fixed size protocol details used for scheduling & reporting (descriptive fields are stored in `metadata`), replaces the legacy `protocols` table
      *
      * ### params
      *
@@ -93,15 +136,14 @@ public:
      * - `{name} status="pending"` - status (`pending/active/denied`)
      * - `{name} category` - protocol category (ex: `dexes/lending/staking`)
      * - `{set<name>} contracts` - EOS contracts
-     * - `{set<string>} evm_contracts` - EOS EVM contracts
+     * - `{set<checksum160>} evm_contracts` - EOS EVM contracts
      * - `{asset} tvl` - reported TVL averaged value in EOS
      * - `{asset} usd` - reported TVL averaged value in USD
      * - `{extended_asset} balance` - balance available to be claimed
-     * - `{map<string, string} metadata` - metadata
-     * - `{time_point_sec} created_at` - created at time
-     * - `{time_point_sec} updated_at` - updated at time
-     * - `{time_point_sec} claimed_at` - claimed at time
      * - `{time_point_sec} period_at` - period at time
+     * - `{time_point_sec} epoch` - epoch of `accrued` rewards (if `config.epoch_interval`)
+     * - `{asset} accrued` - rewards accrued during `epoch`, moved to `balance` by the first report of the next epoch or at `claim`
+     * - `{uint32_t} accrued_interval` - total interval of accrued reports (in seconds)
      *
      * ### example
      *
@@ -111,19 +153,57 @@ public:
      *     "status": "active",
      *     "category": "dexes",
      *     "contracts": ["myprotocol", "mytreasury"],
-     *     "evm_contracts": ["0x2f9ec37d6ccfff1cab21733bdadede11c823ccb0"],
+     *     "evm_contracts": ["2f9ec37d6ccfff1cab21733bdadede11c823ccb0"],
      *     "tvl": "200000.0000 EOS",
      *     "usd": "300000.0000 USD",
      *     "balance": {"quantity": "2.5000 EOS", "contract": "eosio.token"},
-     *     "metadata": [{"key": "name", "value": "My Protocol"}, {"key": "website", "value": "https://myprotocol.com"}],
-     *     "created_at": "2022-05-13T00:00:00",
-     *     "updated_at": "2022-05-13T00:00:00",
-     *     "claimed_at": "1970-01-01T00:00:00",
-     *     "period_at": "1970-01-01T00:00:00"
+     *     "period_at": "1970-01-01T00:00:00",
+     *     "epoch": "2022-05-13T00:00:00",
+     *     "accrued": "0.0600 EOS",
+     *     "accrued_interval": 3600
      * }
      * ```
      */
-    struct [[eosio::table("protocols")]] protocols_row {
+    struct [[eosio::table("protocols.v2")]] protocols_row {
+        name                    protocol;
+        name                    status = "pending"_n;
+        name                    category;
+        set<name>               contracts;
+        set<checksum160>        evm_contracts;
+        asset                   tvl;
+        asset                   usd;
+        extended_asset          balance;
+        time_point_sec          period_at;
+        time_point_sec          epoch;
+        asset                   accrued;
+        uint32_t                accrued_interval;
+
+        uint64_t primary_key() const { return protocol.value; }
+    };
+    typedef eosio::multi_index< "protocols.v2"_n, protocols_row> protocols_table;
+
+    /**
+     * ## TABLE `protocols`
+     *
+     * > Legacy protocols (read-only, moved to `protocols.v2` & `metadata` by `migrate`)
+     *
+     * ### params
+     *
+     * - `{name} protocol` - primary protocol contract
+     * - `{name} status="pending"` - status (`pending/active/denied`)
+     * - `{name} category` - protocol category (ex: `dexes/lending/staking`)
+     * - `{set<name>} contracts` - EOS contracts
+     * - `{set<string>} evm_contracts` - EOS EVM contracts
+     * - `{asset} tvl` - reported TVL averaged value in EOS
+     * - `{asset} usd` - reported TVL averaged value in USD
+     * - `{extended_asset} balance` - balance available to be claimed
+     * - `{map<string, string} metadata` - metadata
+     * - `{time_point_sec} created_at` - created at time
+     * - `{time_point_sec} updated_at` - updated at time
+     * - `{time_point_sec} claimed_at` - claimed at time
+     * - `{time_point_sec} period_at` - period at time
+     */
+    struct [[eosio::table("protocols")]] legacy_protocols_row {
         name                    protocol;
         name                    status = "pending"_n;
         name                    category;
@@ -140,7 +220,43 @@ public:
 
         uint64_t primary_key() const { return protocol.value; }
     };
-    typedef eosio::multi_index< "protocols"_n, protocols_row> protocols_table;
+    typedef eosio::multi_index< "protocols"_n, legacy_protocols_row> legacy_protocols_table;
+
+    /**
+     * ## TABLE `metadata`
+     *
+     * > Descriptive protocol details (not used when reporting TVL)
+     *
+     * ### params
+     *
+     * - `{name} protocol` - primary protocol contract
+     * - `{map<string, string} metadata` - metadata
+     * - `{time_point_sec} created_at` - created at time
+     * - `{time_point_sec} updated_at` - updated at time
+     * - `{time_point_sec} claimed_at` - claimed at time
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "protocol": "myprotocol",
+     *     "metadata": [{"key": "name", "value": "My Protocol"}, {"key": "website", "value": "https://myprotocol.com"}],
+     *     "created_at": "2022-05-13T00:00:00",
+     *     "updated_at": "2022-05-13T00:00:00",
+     *     "claimed_at": "1970-01-01T00:00:00"
+     * }
+     * ```
+     */
+    struct [[eosio::table("metadata")]] metadata_row {
+        name                    protocol;
+        map<name, string>       metadata;
+        time_point_sec          created_at;
+        time_point_sec          updated_at;
+        time_point_sec          claimed_at;
+
+        uint64_t primary_key() const { return protocol.value; }
+    };
+    typedef eosio::multi_index< "metadata"_n, metadata_row> metadata_table;
 
     /**
      * ## ACTION `init`
@@ -187,6 +303,55 @@ public:
     [[eosio::action]]
     void setrate( const optional<int16_t> annual_rate, const optional<asset> min_tvl_report, const optional<asset> max_tvl_report );
 
+    /**
+     * ## ACTION `setepoch`
+     *
+     * > Set rewards settlement epoch at {{epoch_interval}} seconds.
+     *
+     * Rewards are accrued in the `protocols.v2` row and settled by the first report of the next epoch (single `rewardslog` per epoch).
+     * The row is already modified by every report (`tvl`, `usd` & `period_at` are read by the oracle), accrued rewards are part of the same write.
+     * Setting `epoch_interval` back to 0 settles accrued rewards at the next report of each protocol.
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{uint32_t} epoch_interval` - rewards settlement epoch (in seconds, 0 = settle rewards at every report)
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action eosio.yield setepoch '[86400]' -p eosio.yield
+     * ```
+     */
+    [[eosio::action]]
+    void setepoch( const uint32_t epoch_interval );
+
+    /**
+     * ## ACTION `migrate`
+     *
+     * > Move legacy `protocols` rows to `protocols.v2` & `metadata`, and legacy `state` to `active`
+     *
+     * Descriptive fields are moved to `metadata` and EVM contracts are stored as addresses. RAM of moved rows is paid by `get_self()`.
+     * A protocol registered again before being migrated keeps its new row and receives the legacy `balance`.
+     * Active protocols are added to the `active` table (due at the current period), the legacy `state` singleton is removed once every protocol is moved.
+     * Remaining rows are moved by calling the action again.
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{uint16_t} [max_rows=50]` - (optional) maximum legacy rows moved
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action eosio.yield migrate '[null]' -p eosio.yield
+     * ```
+     */
+    [[eosio::action]]
+    void migrate( const optional<uint16_t> max_rows );
+
     /**
      * ## ACTION `regprotocol`
      *
@@ -390,6 +555,8 @@ public:
      *
      * > Generates a report of the current TVL from the {{protocol}} protocol.
      *
+     * The report `period` must be the current 10 minutes period (reports are not required to be aligned to `period_interval`), rewards cover at most the time elapsed since the last report.
+     *
      * - **authority**: `oracle.yield@eosio.code`
      *
      * ### params
@@ -409,6 +576,66 @@ public:
     [[eosio::action]]
     void report( const name protocol, const time_point_sec period, const uint32_t period_interval, const asset tvl, const asset usd );
 
+    /**
+     * ## STRUCT `tvl_report`
+     *
+     * - `{name} protocol` - protocol
+     * - `{time_point_sec} period` - period time
+     * - `{asset} tvl` - TVL averaged value in EOS
+     * - `{asset} usd` - TVL averaged value in USD
+     */
+    struct tvl_report {
+        name                protocol;
+        time_point_sec      period;
+        asset               tvl;
+        asset               usd;
+    };
+
+    /**
+     * ## ACTION `reportbatch`
+     *
+     * > Generates reports of the current TVL from many protocols in a single action.
+     *
+     * - **authority**: `oracle.yield@eosio.code`
+     *
+     * ### params
+     *
+     * - `{uint32_t} period_interval` - period interval (in seconds)
+     * - `{vector<tvl_report>} reports` - TVL reports (all reports must share the same current period)
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action eosio.yield reportbatch '[600, [{"protocol": "myprotocol", "period": "2022-05-13T00:00:00", "tvl": "200000.0000 EOS", "usd": "300000.0000 USD"}]]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void reportbatch( const uint32_t period_interval, const vector<tvl_report> reports );
+
+    /**
+     * ## ACTION `schedule`
+     *
+     * > Reschedule protocols sampled without a report to the next report period.
+     *
+     * Protocols without enough TVL datapoints for a report (ex: first 16 hours) are moved behind protocols due for the current period.
+     *
+     * - **authority**: `oracle.yield@eosio.code`
+     *
+     * ### params
+     *
+     * - `{time_point_sec} period` - sampled period time
+     * - `{uint32_t} period_interval` - report interval (in seconds)
+     * - `{vector<name>} protocols` - protocols sampled without a report
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action eosio.yield schedule '["2022-05-13T00:00:00", 600, [myprotocol]]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void schedule( const time_point_sec period, const uint32_t period_interval, const vector<name> protocols );
+
     /**
      * ## ACTION `claimlog`
      *
@@ -513,7 +740,7 @@ public:
      * - `{name} protocol` - primary protocol contract
      * - `{name} status` - status (`pending/active/denied`)
      * - `{set<name>} contracts.eos` - additional supporting EOS contracts
-     * - `{set<string>} contracts.evm` - additional supporting EVM contracts
+     * - `{set<checksum160>} contracts.evm` - additional supporting EVM contracts
      *
      * ### example
      *
@@ -522,12 +749,12 @@ public:
      *     "protocol": "myprotocol",
      *     "status": "pending",
      *     "contracts": ["myprotocol", "mytreasury"],
-     *     "evm": ["0x2f9ec37d6ccfff1cab21733bdadede11c823ccb0"]
+     *     "evm": ["2f9ec37d6ccfff1cab21733bdadede11c823ccb0"]
      * }
      * ```
      */
     [[eosio::action]]
-    void contractslog( const name protocol, const name status, const set<name> contracts, const set<string> evm );
+    void contractslog( const name protocol, const name status, const set<name> contracts, const set<checksum160> evm );
 
     /**
      * ## ACTION `createlog`
@@ -562,6 +789,8 @@ public:
      *
      * > Generates a log when a protocol is erased.
      *
+     * The oracle contract is notified to erase data kept for the protocol.
+     *
      * - **authority**: `get_self()`
      *
      * ### params
@@ -627,7 +856,11 @@ public:
     using approve_action = eosio::action_wrapper<"approve"_n, &yield::approve>;
     using deny_action = eosio::action_wrapper<"deny"_n, &yield::deny>;
     using setrate_action = eosio::action_wrapper<"setrate"_n, &yield::setrate>;
+    using setepoch_action = eosio::action_wrapper<"setepoch"_n, &yield::setepoch>;
+    using migrate_action = eosio::action_wrapper<"migrate"_n, &yield::migrate>;
     using report_action = eosio::action_wrapper<"report"_n, &yield::report>;
+    using reportbatch_action = eosio::action_wrapper<"reportbatch"_n, &yield::reportbatch>;
+    using schedule_action = eosio::action_wrapper<"schedule"_n, &yield::schedule>;
 
     using rewardslog_action = eosio::action_wrapper<"rewardslog"_n, &yield::rewardslog>;
     using claimlog_action = eosio::action_wrapper<"claimlog"_n, &yield::claimlog>;
@@ -646,11 +879,18 @@ private :
     void transfer( const name from, const name to, const extended_asset value, const string& memo );
     void remove_active_protocol( const name protocol );
     void add_active_protocol( const name protocol );
+    void set_active_due( const name protocol, const time_point_sec due_at );
     void notify_admin();
     void require_auth_admin();
     void require_auth_admin( const name account );
     bool is_contract( const name contract );
     name get_ram_payer( const name account );
+    void set_updated_at( const name protocol );
+
+    // reports
+    void check_report_period( const config_row& config, const time_point_sec period, const uint32_t period_interval );
+    void add_report( const config_row& config, const tvl_report& report, const uint32_t period_interval );
+    void settle_rewards( const name protocol );
 
     // DEBUG (used to help testing)
     #ifdef DEBUG
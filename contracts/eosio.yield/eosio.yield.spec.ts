@@ -1,7 +1,7 @@
-import { Name } from "@greymass/eosio";
+import { Name, Asset, TimePointSec } from "@greymass/eosio";
 import { expectToThrow, mapToObject } from "@tests/helpers";
-import { YieldConfig, Protocol } from "@tests/interfaces"
-import { contracts } from "@tests/init"
+import { YieldConfig, Protocol, LegacyProtocol, Metadata, Active } from "@tests/interfaces"
+import { blockchain, contracts } from "@tests/init"
 import { category, category1, eos_contracts, evm_contracts, metadata_yield, RATE, MIN_TVL, MAX_TVL, PERIOD_INTERVAL } from "@tests/constants"
 
 // get tables
@@ -11,11 +11,47 @@ const getConfig = (): YieldConfig => {
 }
 
 const getProtocol = ( protocol: string ): Protocol => {
+  const scope = Name.from('eosio.yield').value.value;
+  const primaryKey = Name.from(protocol).value.value;
+  return contracts.yield.eosio.tables["protocols.v2"](scope).getTableRow(primaryKey);
+}
+
+const getLegacyProtocol = ( protocol: string ): LegacyProtocol => {
   const scope = Name.from('eosio.yield').value.value;
   const primaryKey = Name.from(protocol).value.value;
   return contracts.yield.eosio.tables.protocols(scope).getTableRow(primaryKey);
 }
 
+const getMetadata = ( protocol: string ): Metadata => {
+  const scope = Name.from('eosio.yield').value.value;
+  const primaryKey = Name.from(protocol).value.value;
+  return contracts.yield.eosio.tables.metadata(scope).getTableRow(primaryKey);
+}
+
+const getActive = ( protocol: string ): Active => {
+  const scope = Name.from('eosio.yield').value.value;
+  const primaryKey = Name.from(protocol).value.value;
+  return contracts.yield.eosio.tables.active(scope).getTableRow(primaryKey);
+}
+
+// current period (same as `yield::get_current_period`)
+const getCurrentPeriod = (): string => {
+  const now = Math.floor(blockchain.timestamp.toMilliseconds() / 1000);
+  return TimePointSec.from(now - now % PERIOD_INTERVAL.value.toNumber()).toString();
+}
+
+const report = ( protocol: string, period: string, tvl: string ) => {
+  return contracts.yield.eosio.actions.report([protocol, period, 600, tvl, "0.0000 USD"]).send('oracle.yield@active');
+}
+
+const calculateRewards = ( tvl: string, period_interval = 600 ) => {
+  return Number(BigInt(Asset.from(tvl).units.toNumber()) * BigInt(RATE) * BigInt(period_interval) / 10000n / 31536000n);
+}
+
+const getUnits = ( quantity: string ): number => {
+  return Asset.from(quantity).units.toNumber();
+}
+
 const getStatus = ( protocol: string ): string => {
   return getProtocol( protocol )?.status;
 }
@@ -45,10 +81,17 @@ describe('eosio.yield', () => {
     expect(config.max_tvl_report).toBe(MAX_TVL);
   });
 
+  it("config::setepoch", async () => {
+    await contracts.yield.eosio.actions.setepoch([86400]).send();
+    expect(getConfig().epoch_interval).toBe(86400);
+    await contracts.yield.eosio.actions.setepoch([0]).send();
+    expect(getConfig().epoch_interval).toBe(0);
+  });
+
   it("regprotocol", async () => {
     await contracts.yield.eosio.actions.regprotocol(["myprotocol", category, metadata_yield]).send('myprotocol@active');
     const protocol = getProtocol("myprotocol");
-    expect(protocol.metadata).toEqual(metadata_yield);
+    expect(getMetadata("myprotocol").metadata).toEqual(metadata_yield);
     expect(protocol.status).toEqual("pending");
   });
 
@@ -64,7 +107,7 @@ describe('eosio.yield', () => {
 
   it("setmetadata", async () => {
     await contracts.yield.eosio.actions.setmetadata(["myprotocol", metadata_yield]).send('myprotocol@active');
-    const protocol = getProtocol("myprotocol");
+    const protocol = getMetadata("myprotocol");
     expect(protocol.metadata).toEqual(metadata_yield);
   });
 
@@ -76,10 +119,12 @@ describe('eosio.yield', () => {
     // approve
     await contracts.yield.eosio.actions.approve(["protocol1"]).send('admin.yield@active');
     expect(getStatus("protocol1")).toEqual("active");
+    expect(getActive("protocol1").due_at).toEqual(getCurrentPeriod());
 
     // deny
     await contracts.yield.eosio.actions.deny(["protocol1"]).send('admin.yield@active');
     expect(getStatus("protocol1")).toEqual("denied");
+    expect(getActive("protocol1")).toEqual(undefined);
 
     // approve after denied
     await contracts.yield.eosio.actions.regprotocol(["protocol1", category, metadata_yield]).send('protocol1@active');
@@ -113,14 +158,14 @@ describe('eosio.yield', () => {
 
   it("setmetakey", async () => {
     await contracts.yield.eosio.actions.setmetakey(["myprotocol", metadata_yield[0].key, metadata_yield[0].value]).send('myprotocol@active');
-    const protocol = getProtocol("myprotocol");
+    const protocol = getMetadata("myprotocol");
     expect(protocol.metadata).toEqual(metadata_yield);
   });
 
   it("setmetakey:: add token", async () => {
     await contracts.yield.eosio.actions.setmetakey(["myprotocol", "token.code", "eosio.token"]).send('myprotocol@active');
     await contracts.yield.eosio.actions.setmetakey(["myprotocol", "token.symcode", "EOS"]).send('myprotocol@active');
-    const protocol = getProtocol("myprotocol");
+    const protocol = getMetadata("myprotocol");
     expect(mapToObject(protocol.metadata)["token.code"]).toEqual("eosio.token");
     expect(mapToObject(protocol.metadata)["token.symcode"]).toEqual("EOS");
 
@@ -131,7 +176,7 @@ describe('eosio.yield', () => {
 
   it("setmetakey:: Recover+ as integer", async () => {
     await contracts.yield.eosio.actions.setmetakey(["myprotocol", "recover", 123]).send('myprotocol@active');
-    const protocol = getProtocol("myprotocol");
+    const protocol = getMetadata("myprotocol");
     expect(mapToObject(protocol.metadata).recover).toEqual("123");
 
     // TO-DO: Vert requires fix to support inline action error throwing
@@ -139,6 +184,16 @@ describe('eosio.yield', () => {
     // await expectToThrow(action, "invalid integer value");
   });
 
+  it("reportbatch::error::missing required authority", async () => {
+    const action = contracts.yield.eosio.actions.reportbatch([PERIOD_INTERVAL, []]).send('myaccount@active');
+    await expectToThrow(action, "missing required authority");
+  });
+
+  it("reportbatch::error::empty reports", async () => {
+    const action = contracts.yield.eosio.actions.reportbatch([PERIOD_INTERVAL, []]).send('oracle.yield@active');
+    await expectToThrow(action, "eosio_assert: yield::reportbatch: [reports] is empty");
+  });
+
   it("setcontracts", async () => {
     const auth = eos_contracts.map(contract => { return { actor: contract, permission: "active"} });
     await contracts.yield.eosio.actions.setcontracts([ "myprotocol", eos_contracts, [] ]).send(auth);
@@ -167,7 +222,7 @@ describe('eosio.yield', () => {
   it("setmetakey - valid IPFS", async () => {
     const ipfs = "QmSPLWbpUttHQqd4gPnPKBGE6XWy6PricPgfns9LXoUjdk"
     await contracts.yield.eosio.actions.setmetakey(["myprotocol", "logo", ipfs]).send('myprotocol@active');
-    const protocol = getProtocol("myprotocol");
+    const protocol = getMetadata("myprotocol");
     for ( const row of protocol.metadata ) {
       if ( row.key == "logo") expect(row.value).toEqual(ipfs);
     }
@@ -183,4 +238,127 @@ describe('eosio.yield', () => {
     const action3 = contracts.yield.eosio.actions.setmetakey(["myprotocol", "logo", "SPLWbpUttHQqd4gPnPKBGE6XWy6PricPgfns9LXoUjdk"]).send('myprotocol@active');
     await expectToThrow(action3, "invalid IPFS value");
   });
+
+  it("migrate::legacy protocol", async () => {
+    // protocol registered before `protocols.v2` (metadata stored in the protocol row)
+    const scope = Name.from('eosio.yield').value.value;
+    contracts.yield.eosio.tables.protocols(scope).set(Name.from("protocol2").value.value, Name.from("protocol2"), {
+      protocol: "protocol2",
+      status: "active",
+      category,
+      contracts: ["protocol2"],
+      evm_contracts: [],
+      tvl: "300000.0000 EOS",
+      usd: "450000.0000 USD",
+      balance: {quantity: "1.0000 EOS", contract: "eosio.token"},
+      metadata: metadata_yield,
+      created_at: "2022-05-13T00:00:00",
+      updated_at: "2022-05-14T00:00:00",
+      claimed_at: "1970-01-01T00:00:00",
+      period_at: "1970-01-01T00:00:00",
+    });
+    // legacy active protocols singleton
+    contracts.yield.eosio.tables.state(scope).set(Name.from("state").value.value, Name.from("eosio.yield"), {
+      active_protocols: ["protocol2"],
+    });
+    await contracts.yield.eosio.actions.migrate([null]).send();
+    expect(getLegacyProtocol("protocol2")).toBeUndefined();
+    expect(getActive("protocol2").due_at).toEqual(getCurrentPeriod());
+    expect(contracts.yield.eosio.tables.state(scope).getTableRows().length).toEqual(0);
+
+    const protocol = getProtocol("protocol2");
+    expect(protocol.status).toEqual("active");
+    expect(protocol.contracts).toEqual(["protocol2"]);
+    expect(protocol.balance.quantity).toEqual("1.0000 EOS");
+    const metadata = getMetadata("protocol2");
+    expect(metadata.metadata).toEqual(metadata_yield);
+    expect(metadata.created_at).toEqual("2022-05-13T00:00:00");
+
+    // metadata actions & claim use the migrated rows
+    await contracts.yield.eosio.actions.setmetakey(["protocol2", "name", "Protocol 2"]).send('protocol2@active');
+    expect(mapToObject(getMetadata("protocol2").metadata).name).toEqual("Protocol 2");
+    await contracts.token.EOS.actions.transfer(["eosio", "eosio.yield", "1.0000 EOS", "init"]).send("eosio@active");
+    await contracts.yield.eosio.actions.claim(["protocol2", "protocol2", ""]).send('protocol2@active');
+    expect(getProtocol("protocol2").balance.quantity).toEqual("0.0000 EOS");
+    expect(getMetadata("protocol2").claimed_at).not.toEqual("1970-01-01T00:00:00");
+
+    const action = contracts.yield.eosio.actions.migrate([null]).send();
+    await expectToThrow(action, "eosio_assert: yield::migrate: no legacy protocols to migrate");
+  });
+
+  it("schedule::due period", async () => {
+    blockchain.setTime(TimePointSec.from("2030-01-01T00:00:00"));
+    await contracts.yield.eosio.actions.schedule(["2030-01-01T00:00:00", 600, ["myprotocol"]]).send('oracle.yield@active');
+    expect(getActive("myprotocol").due_at).toEqual("2030-01-01T00:10:00");
+
+    // due period is never moved back
+    await contracts.yield.eosio.actions.schedule(["2029-12-31T23:50:00", 600, ["myprotocol"]]).send('oracle.yield@active');
+    expect(getActive("myprotocol").due_at).toEqual("2030-01-01T00:10:00");
+
+    const action1 = contracts.yield.eosio.actions.schedule(["2030-01-01T00:10:00", 600, ["myprotocol"]]).send('oracle.yield@active');
+    await expectToThrow(action1, "eosio_assert: yield::schedule: [period] cannot be in the future");
+
+    const action2 = contracts.yield.eosio.actions.schedule(["2030-01-01T00:00:00", 600, ["myprotocol"]]).send('myaccount@active');
+    await expectToThrow(action2, "missing required authority");
+  });
+
+  it("report::epoch accrual & settlement", async () => {
+    await contracts.yield.eosio.actions.approve([ "myprotocol" ]).send("admin.yield@active");
+    await contracts.yield.eosio.actions.setepoch([86400]).send();
+    blockchain.setTime(TimePointSec.from("2030-01-01T23:40:00"));
+    const rewards = calculateRewards("300000.0000 EOS");
+    const balance = getUnits(getProtocol("myprotocol").balance.quantity);
+
+    // rewards are accrued in the protocol row (balance unchanged)
+    await report("myprotocol", "2030-01-01T23:40:00", "300000.0000 EOS");
+    let protocol = getProtocol("myprotocol");
+    expect(getUnits(protocol.balance.quantity)).toEqual(balance);
+    expect(getUnits(protocol.accrued)).toEqual(rewards);
+    expect(protocol.accrued_interval).toEqual(600);
+    expect(protocol.epoch).toEqual("2030-01-01T00:00:00");
+
+    // same epoch
+    blockchain.addTime(PERIOD_INTERVAL);
+    await report("myprotocol", "2030-01-01T23:50:00", "300000.0000 EOS");
+    protocol = getProtocol("myprotocol");
+    expect(getUnits(protocol.balance.quantity)).toEqual(balance);
+    expect(getUnits(protocol.accrued)).toEqual(rewards * 2);
+    expect(protocol.accrued_interval).toEqual(1200);
+
+    // first report of the next epoch settles the previous one
+    blockchain.addTime(PERIOD_INTERVAL);
+    await report("myprotocol", "2030-01-02T00:00:00", "300000.0000 EOS");
+    protocol = getProtocol("myprotocol");
+    expect(getUnits(protocol.balance.quantity)).toEqual(balance + rewards * 2);
+    expect(getUnits(protocol.accrued)).toEqual(rewards);
+    expect(protocol.accrued_interval).toEqual(600);
+    expect(protocol.epoch).toEqual("2030-01-02T00:00:00");
+  });
+
+  it("report::setepoch 0 settles accrued rewards", async () => {
+    const rewards = calculateRewards("300000.0000 EOS");
+    const before = getProtocol("myprotocol");
+    await contracts.yield.eosio.actions.setepoch([0]).send();
+
+    // accrued rewards & current rewards are added to the balance
+    blockchain.addTime(PERIOD_INTERVAL);
+    await report("myprotocol", "2030-01-02T00:10:00", "300000.0000 EOS");
+    const after = getProtocol("myprotocol");
+    expect(getUnits(after.balance.quantity)).toEqual(getUnits(before.balance.quantity) + getUnits(before.accrued) + rewards);
+    expect(getUnits(after.accrued)).toEqual(0);
+    expect(after.accrued_interval).toEqual(0);
+  });
+
+  it("report::rewards capped by elapsed time", async () => {
+    blockchain.setTime(TimePointSec.from("2030-01-02T00:50:00"));
+    await report("myprotocol", "2030-01-02T00:50:00", "300000.0000 EOS");
+    const before = getUnits(getProtocol("myprotocol").balance.quantity);
+
+    // hourly report 10 minutes after the last report only covers 10 minutes
+    blockchain.addTime(PERIOD_INTERVAL);
+    await contracts.yield.eosio.actions.report(["myprotocol", "2030-01-02T01:00:00", 3600, "300000.0000 EOS", "0.0000 USD"]).send('oracle.yield@active');
+    const after = getProtocol("myprotocol");
+    expect(after.period_at).toEqual("2030-01-02T01:00:00");
+    expect(getUnits(after.balance.quantity)).toEqual(before + calculateRewards("300000.0000 EOS", 600));
+  });
 });
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <eosio/eosio.hpp>
+
+#include <array>
+#include <limits>
+
+/**
+ * Header-only fixed point decimals backed by `int128_t`
+ *
+ * Shared by `eosio.yield` & `oracle.yield` to compute TVL valuations & rewards without floating point.
+ * Every multiplication is overflow checked and every division asserts a non-zero divisor.
+ */
+namespace fixed {
+
+    // powers of ten (10^0 .. 10^38) that fit in int128
+    static constexpr std::array<int128_t, 39> POW10 = []() {
+        std::array<int128_t, 39> table{};
+        table[0] = 1;
+        for ( size_t i = 1; i < table.size(); ++i ) table[i] = table[i - 1] * 10;
+        return table;
+    }();
+
+    static constexpr int128_t MAX_INT128 = int128_t( ~uint128_t(0) >> 1 );
+
+    inline int128_t pow10( const uint8_t exponent )
+    {
+        eosio::check( exponent < POW10.size(), "fixed::pow10: [exponent] out of range" );
+        return POW10[exponent];
+    }
+
+    // overflow is checked by hand (`__builtin_mul_overflow` on int128 requires `__muloti4` which is not provided by CDT)
+    inline int128_t mul( const int128_t x, const int128_t y )
+    {
+        if ( x == 0 || y == 0 ) return 0;
+
+        // multiply magnitudes, result must fit in [-MAX_INT128 - 1, MAX_INT128]
+        const bool negative = ( x < 0 ) != ( y < 0 );
+        const uint128_t abs_x = x < 0 ? -uint128_t(x) : uint128_t(x);
+        const uint128_t abs_y = y < 0 ? -uint128_t(y) : uint128_t(y);
+        const uint128_t limit = uint128_t( MAX_INT128 ) + ( negative ? 1 : 0 );
+        eosio::check( abs_x <= limit / abs_y, "fixed::mul: overflow" );
+
+        const uint128_t result = abs_x * abs_y;
+        return negative ? int128_t( -result ) : int128_t( result );
+    }
+
+    inline int128_t div( const int128_t x, const int128_t y )
+    {
+        eosio::check( y != 0, "fixed::div: division by zero" );
+        return x / y;
+    }
+
+    inline int64_t to_int64( const int128_t x )
+    {
+        eosio::check( x >= std::numeric_limits<int64_t>::min() && x <= std::numeric_limits<int64_t>::max(), "fixed::to_int64: out of range" );
+        return int64_t(x);
+    }
+
+    /**
+     * Decimal value with `P` digits of precision (ex: `decimal<4>` for `4,EOS` & `4,USD` amounts)
+     */
+    template <uint8_t P>
+    struct decimal {
+        static_assert( P < POW10.size(), "fixed::decimal: precision out of range" );
+        static constexpr int128_t SCALE = POW10[P];
+
+        int128_t value = 0; // scaled by 10^P
+
+        static decimal from_raw( const int128_t value )
+        {
+            return decimal{ value };
+        }
+
+        // rescale `amount` from `precision` digits (truncates extra digits)
+        static decimal from_amount( const int64_t amount, const uint8_t precision )
+        {
+            if ( precision <= P ) return decimal{ mul( amount, pow10( P - precision ) ) };
+            return decimal{ amount / pow10( precision - P ) };
+        }
+
+        // raw amount with `P` digits of precision
+        int64_t amount() const
+        {
+            return to_int64( value );
+        }
+
+        template <uint8_t Q>
+        decimal operator*( const decimal<Q>& rhs ) const
+        {
+            return decimal{ mul( value, rhs.value ) / decimal<Q>::SCALE };
+        }
+
+        template <uint8_t Q>
+        decimal operator/( const decimal<Q>& rhs ) const
+        {
+            return decimal{ div( mul( value, decimal<Q>::SCALE ), rhs.value ) };
+        }
+
+        decimal operator*( const int128_t rhs ) const { return decimal{ mul( value, rhs ) }; }
+        decimal operator/( const int128_t rhs ) const { return decimal{ div( value, rhs ) }; }
+        decimal operator+( const decimal& rhs ) const { return decimal{ value + rhs.value }; }
+        decimal operator-( const decimal& rhs ) const { return decimal{ value - rhs.value }; }
+
+        bool operator<( const decimal& rhs ) const { return value < rhs.value; }
+        bool operator>( const decimal& rhs ) const { return value > rhs.value; }
+        bool operator==( const decimal& rhs ) const { return value == rhs.value; }
+        bool operator!=( const decimal& rhs ) const { return value != rhs.value; }
+    };
+}
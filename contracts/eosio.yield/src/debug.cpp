@@ -19,11 +19,15 @@ void yield::cleartable( const name table_name, const optional<name> scope, const
     // tables
     yield::config_table _config( get_self(), value );
     yield::protocols_table _protocols( get_self(), value );
-    yield::state_table _state( get_self(), value );
+    yield::legacy_protocols_table _legacy_protocols( get_self(), value );
+    yield::metadata_table _metadata( get_self(), value );
+    yield::active_table _active( get_self(), value );
 
-    if (table_name == "protocols"_n) clear_table( _protocols, rows_to_clear );
+    if (table_name == "protocols.v2"_n) clear_table( _protocols, rows_to_clear );
+    else if (table_name == "protocols"_n) clear_table( _legacy_protocols, rows_to_clear );
+    else if (table_name == "metadata"_n) clear_table( _metadata, rows_to_clear );
+    else if (table_name == "active"_n) clear_table( _active, rows_to_clear );
     else if (table_name == "config"_n) _config.remove();
-    else if (table_name == "state"_n) _state.remove();
     else check(false, "yield::cleartable: [table_name] unknown table to clear" );
 }
 
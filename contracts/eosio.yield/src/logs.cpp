@@ -36,7 +36,7 @@ void yield::statuslog( const name protocol, const name status )
 
 // @eosio.code
 [[eosio::action]]
-void yield::contractslog( const name protocol, const name status, const set<name> contracts, const set<string> evm )
+void yield::contractslog( const name protocol, const name status, const set<name> contracts, const set<checksum160> evm )
 {
     require_auth( get_self() );
     notify_admin();
@@ -56,6 +56,7 @@ void yield::eraselog( const name protocol )
 {
     require_auth( get_self() );
     notify_admin();
+    require_recipient( get_config().oracle_contract );
 }
 
 // @eosio.code
@@ -11,6 +11,9 @@
 #include <eosio.evm/silkworm.hpp>
 #include <eosio.evm/intx.hpp>
 
+// fixed point math
+#include <eosio.yield/fixed_point.hpp>
+
 // core
 #include <oracle.yield/oracle.yield.hpp>
 
@@ -20,6 +23,7 @@
 // EOS EVM support
 #include "src/evm.cpp"
 #include "src/evm.callback.cpp"
+#include "src/evm.multicall.cpp"
 
 // DEBUG (used to help testing)
 #ifdef DEBUG
@@ -260,6 +264,9 @@ void oracle::addtoken( const symbol_code symcode, const name contract, const opt
     auto itr = _tokens.find( symcode.raw() );
     if ( itr == _tokens.end() ) _tokens.emplace( get_self(), insert );
     else _tokens.modify( itr, get_self(), insert );
+
+    // refresh contract holdings
+    set_tokens_modified();
 }
 
 // @system
@@ -300,6 +307,9 @@ void oracle::deltoken( const symbol_code symcode )
     oracle::tokens_table _tokens( get_self(), get_self().value );
     auto & itr = _tokens.get( symcode.raw(), "oracle::deltoken: [symcode] does not exists" );
     _tokens.erase( itr );
+
+    // refresh contract holdings
+    set_tokens_modified();
 }
 
 // @oracle
@@ -310,114 +320,317 @@ void oracle::updateall( const name oracle, const optional<uint16_t> max_rows )
 
     auto config = get_config();
     yield::protocols_table _protocols( config.yield_contract, config.yield_contract.value );
-    yield::state_table _state( config.yield_contract, config.yield_contract.value );
+    yield::active_table _active( config.yield_contract, config.yield_contract.value );
+    oracle::state_table _oracle_state( get_self(), get_self().value );
+    oracle::cursors_table _cursors( get_self(), get_self().value );
     oracle::evm_tokens_table _evm_tokens( get_self(), get_self().value );
     oracle::balanceof_action balanceof( get_self(), { get_self(), "active"_n });
-    oracle::update_action update( get_self(), { get_self(), "active"_n });
+    oracle::balancesof_action balancesof( get_self(), { get_self(), "active"_n });
+    oracle::updatebatch_action updatebatch( get_self(), { get_self(), "active"_n });
+    oracle::flushreports_action flushreports( get_self(), { get_self(), "active"_n });
 
     const time_point_sec period = get_current_period( PERIOD_INTERVAL );
-    check( _state.exists(), "oracle::updateall: [yield_contract.state] does not exists");
-    auto state = _state.get();
+    auto oracle_state = _oracle_state.get_or_default();
+    auto cursor_itr = _cursors.find( oracle.value );
+    oracle::cursors_row scan = cursor_itr != _cursors.end() ? *cursor_itr : oracle::cursors_row{ oracle };
+
+    // oracle slot (sharding)
+    check_oracle_active( oracle );
+    uint64_t slots = 0;
+    const uint64_t slot = get_oracle_slot( oracle, slots );
 
     int limit = max_rows ? *max_rows : 20;
     int count = 0;
     check( limit, "oracle::updateall: [max_rows] must be above 0");
+    vector<name> protocols;
+
+    // estimated CPU cost of packed protocols (limited by `update_budget`)
+    oracle::tokens_table _tokens( get_self(), get_self().value );
+    const uint32_t tokens = std::distance( _tokens.begin(), _tokens.end() );
+    const uint32_t evm_tokens = std::distance( _evm_tokens.begin(), _evm_tokens.end() );
+    uint32_t cost = 0;
+
+    // only protocols due at or before the current period (ordered by due period)
+    // protocols are sampled between reports, due period is the next report (`report_interval` ahead)
+    // resume after last scanned protocol within the same period
+    auto _active_by_due = _active.get_index<"by.due"_n>();
+    auto itr = _active_by_due.begin();
+    if ( scan.period == period ) itr = _active_by_due.upper_bound( yield::get_due_key( scan.due_at, scan.protocol ) );
+    const time_point_sec due_at = period + config.report_interval.value();
+
+    for ( ; itr != _active_by_due.end() && itr->due_at <= due_at; ++itr ) {
+        const name active_protocol = itr->protocol;
+        const auto last_scan = scan;
+        scan.protocol = active_protocol;
+        scan.due_at = itr->due_at;
+        scan.period = period;
 
-    for ( const name active_protocol : state.active_protocols ) {
         // TVL periods
         oracle::periods_table _periods( get_self(), active_protocol.value );
-        auto period_itr = _periods.find( period.sec_since_epoch()  ); // inverse multi-index
-        if ( period_itr != _periods.end() ) continue; // skip, period already updated
+        auto period_itr = _periods.find( get_period_key( period, config.ring_buffer.value() ) );
+        if ( period_itr != _periods.end() && period_itr->period == period ) continue; // skip, period already updated
 
         // skip based on protocol details
         auto protocol = _protocols.get( active_protocol.value, "oracle::updateall: [yield_contract.protocols] does not exists");
         if ( protocol.period_at == period ) continue; // protocol period already updated
         if ( protocol.status != "active"_n ) continue; // protocol not active
 
-        // trigger EOS EVM callback `balanceof`
-        // must be used prior to `update` action to ensure balances are up to date
-        for ( const string evm_contract : protocol.evm_contracts ) {
-            for ( const auto evm_token : _evm_tokens ) {
-                balanceof.send( evm_token.address, *silkworm::from_hex(evm_contract) );
+        // low TVL protocols are only sampled every `tier_interval`
+        const uint32_t interval = get_sampling_interval( config, protocol.tvl );
+        if ( period.sec_since_epoch() % interval ) continue;
+
+        // skip protocols assigned to other oracle slots, unless overdue (failover)
+        if ( get_protocol_slot( active_protocol, slots ) != slot && !is_period_missed( active_protocol, period, interval, itr->due_at, protocol.period_at, config.ring_buffer.value() ) ) continue;
+
+        // contracts read by the next `update` chunk (EOS contracts followed by EVM contracts)
+        const uint16_t cursor = get_update_cursor( active_protocol, period, protocol.contracts, protocol.evm_contracts );
+        const uint16_t total = protocol.contracts.size() + protocol.evm_contracts.size();
+        const uint16_t end = std::min<uint16_t>( total, cursor + UPDATE_CHUNK_SIZE );
+
+        // stop once the next chunk exceeds the budget (at least one protocol is updated)
+        const uint16_t eos_contracts = protocol.contracts.size();
+        const uint16_t chunk_contracts = end - cursor;
+        const uint16_t chunk_eos = cursor >= eos_contracts ? 0 : std::min<uint16_t>( end, eos_contracts ) - cursor;
+        const uint32_t estimate = estimate_update_cost( oracle, active_protocol, chunk_eos, chunk_contracts - chunk_eos, tokens, evm_tokens );
+        if ( config.update_budget.value() && count && cost + estimate > config.update_budget.value() ) {
+            scan = last_scan;
+            break;
+        }
+        cost += estimate;
+
+        // trigger EOS EVM callback `balanceof` (or a single `balancesof` multicall)
+        // must be used prior to `updatebatch` action to ensure balances are up to date
+        vector<bytes> addresses;
+        uint16_t index = protocol.contracts.size();
+        for ( const checksum160& evm_contract : protocol.evm_contracts ) {
+            if ( index >= cursor && index < end ) addresses.push_back( evm_contract::to_bytes( evm_contract ) );
+            index += 1;
+        }
+        if ( config.multicall.value().size() ) {
+            if ( addresses.size() && _evm_tokens.begin() != _evm_tokens.end() ) balancesof.send( addresses );
+        } else {
+            for ( const bytes& address : addresses ) {
+                for ( const auto evm_token : _evm_tokens ) {
+                    balanceof.send( evm_token.address, address );
+                }
             }
         }
 
-        update.send( oracle, active_protocol );
+        protocols.push_back( active_protocol );
         count += 1;
+
+        // chunked update, resume the same protocol on the next `updateall`
+        if ( end < total ) {
+            scan = last_scan;
+            break;
+        }
         if ( count >= limit ) break;
     }
     check( count, "oracle::updateall: nothing to update");
+
+    // save oracle cursor
+    if ( cursor_itr == _cursors.end() ) _cursors.emplace( get_self(), [&]( auto& row ) { row = scan; });
+    else _cursors.modify( cursor_itr, get_self(), [&]( auto& row ) { row = scan; });
+
+    // protocols are updated in a single batch after EVM callbacks
+    // reports are queued by each update and sent together once all updates are completed
+    oracle_state.batch_reports = true;
+    _oracle_state.set( oracle_state, get_self() );
+    updatebatch.send( oracle, protocols );
+    flushreports.send();
 }
 
 // @system side effect action called from `updateall`
 [[eosio::action]]
+void oracle::flushreports()
+{
+    require_auth( get_self() );
+
+    auto config = get_config();
+    oracle::reports_table _reports( get_self(), get_self().value );
+    oracle::state_table _state( get_self(), get_self().value );
+
+    // collect queued reports (grouped by sampling interval)
+    // empty TVL rows are only rescheduled (grouped by period & sampling interval)
+    map<uint32_t, vector<yield::tvl_report>> reports;
+    map<pair<uint32_t, uint32_t>, vector<name>> schedules;
+    for ( auto itr = _reports.begin(); itr != _reports.end(); ) {
+        if ( itr->tvl.amount ) reports[itr->period_interval].push_back({ itr->protocol, itr->period, itr->tvl, itr->usd });
+        else schedules[{ itr->period.sec_since_epoch(), itr->period_interval }].push_back( itr->protocol );
+        itr = _reports.erase( itr );
+    }
+
+    // stop queuing reports
+    auto state = _state.get_or_default();
+    state.batch_reports = false;
+    _state.set( state, get_self() );
+
+    // send oracle reports to Yield+ Rewards (one batch per sampling interval)
+    yield::reportbatch_action reportbatch( config.yield_contract, { get_self(), "active"_n });
+    for ( const auto& [ interval, interval_reports ] : reports ) {
+        reportbatch.send( interval, interval_reports );
+    }
+
+    // move protocols without enough datapoints to the next report period
+    yield::schedule_action schedule( config.yield_contract, { get_self(), "active"_n });
+    for ( const auto& [ key, protocols ] : schedules ) {
+        schedule.send( time_point_sec( key.first ), key.second, protocols );
+    }
+}
+
+// @system
+[[eosio::action]]
 void oracle::update( const name oracle, const name protocol )
 {
     require_auth( get_self() );
     check_oracle_active( oracle );
+    update_context context = get_update_context( oracle );
+    const name reason = update_protocol( context, protocol, false );
+    if ( reason != "partial"_n ) allocate_oracle_rewards( context.config, oracle, 1 );
+}
 
-    // tables
-    auto config = get_config();
-    oracle::tokens_table _tokens( get_self(), get_self().value );
+// @system side effect action called from `updateall`
+[[eosio::action]]
+void oracle::updatebatch( const name oracle, const vector<name> protocols )
+{
+    require_auth( get_self() );
+    check_oracle_active( oracle );
+
+    // shared state is loaded once for all protocols
+    update_context context = get_update_context( oracle );
+
+    // skip protocols that cannot be updated instead of aborting the whole batch
+    uint16_t updated = 0;
+    map<name, name> skipped;
+    for ( const name protocol : protocols ) {
+        const name reason = update_protocol( context, protocol, true );
+        if ( reason == "partial"_n ) continue; // chunked update, remaining contracts are read next `updateall`
+        if ( reason.value ) skipped[protocol] = reason;
+        else updated += 1;
+    }
+
+    // rewards are allocated once for all updates
+    if ( updated ) allocate_oracle_rewards( context.config, oracle, updated );
+
+    // logging
+    if ( skipped.empty() ) return;
+    oracle::skiplog_action skiplog( get_self(), { get_self(), "active"_n });
+    skiplog.send( oracle, context.period, updated, skipped );
+}
+
+oracle::update_context oracle::get_update_context( const name oracle )
+{
+    oracle::state_table _state( get_self(), get_self().value );
     oracle::evm_tokens_table _evm_tokens( get_self(), get_self().value );
-    oracle::oracles_table _oracles( get_self(), get_self().value );
+
+    update_context context;
+    context.oracle = oracle;
+    context.config = get_config();
+    context.period = get_current_period( PERIOD_INTERVAL );
+    context.batch_reports = _state.get_or_default().batch_reports;
+    for ( const auto& evm_token : _evm_tokens ) {
+        context.evm_tokens.push_back( evm_token );
+    }
+    return context;
+}
+
+// returns skip reason when `soft` (empty name when updated, `partial` when more chunks remain), asserts otherwise
+// oracle rewards are allocated by the caller
+name oracle::update_protocol( update_context& context, const name protocol, const bool soft )
+{
+    // tables
+    const auto& config = context.config;
     oracle::periods_table _periods( get_self(), protocol.value );
     yield::protocols_table _protocols( config.yield_contract, config.yield_contract.value );
 
-    // get oracle
-    const auto oracle_itr = _oracles.get( oracle.value, "oracle::update: [oracle] does not exists" );
-    check( oracle_itr.status == "active"_n, "oracle::update: [oracle] must be active" );
-
     // get protocol details
-    const auto protocol_itr = _protocols.get( protocol.value, "oracle::update: [protocol] does not exists" );
-    check( protocol_itr.status == "active"_n, "oracle::update: [protocol] must be active" );
+    auto protocol_itr = _protocols.find( protocol.value );
+    if ( protocol_itr == _protocols.end() ) {
+        check( soft, "oracle::update: [protocol] does not exists" );
+        return "notexists"_n;
+    }
+    if ( protocol_itr->status != "active"_n ) {
+        check( soft, "oracle::update: [protocol] must be active" );
+        return "notactive"_n;
+    }
 
     // get current period
-    const time_point_sec period = get_current_period( PERIOD_INTERVAL );
-    auto itr = _periods.find( period.sec_since_epoch() ); // inverse multi-index
-    check( itr == _periods.end(), "oracle::update: [period] for [protocol] is already updated" );
+    const time_point_sec period = context.period;
+    const uint64_t key = get_period_key( period, config.ring_buffer.value() );
+    auto itr = _periods.find( key );
+    if ( itr != _periods.end() && itr->period == period ) {
+        check( soft, "oracle::update: [period] for [protocol] is already updated" );
+        return "updated"_n;
+    }
+    if ( soft && !is_price_valid( EOS ) ) return "price"_n;
 
     // contracts
-    const set<name> contracts = protocol_itr.contracts;
-    const set<string> evm_contracts = protocol_itr.evm_contracts;
-    const name category = protocol_itr.category;
+    const set<name> contracts = protocol_itr->contracts;
+    const set<checksum160> evm_contracts = protocol_itr->evm_contracts;
+    const name category = protocol_itr->category;
+
+    // resume partial balances of a chunked update
+    oracle::scratch_table _scratch( get_self(), get_self().value );
+    auto scratch_itr = _scratch.find( protocol.value );
+    const uint16_t cursor = get_update_cursor( protocol, period, contracts, evm_contracts );
+    const uint16_t total = contracts.size() + evm_contracts.size();
+    const uint16_t end = std::min<uint16_t>( total, cursor + UPDATE_CHUNK_SIZE );
+    uint16_t index = 0;
 
     // get all balances from protocol EOS contracts
     vector<asset> balances;
     vector<asset> prices;
+    if ( cursor ) {
+        balances = scratch_itr->balances;
+        prices = scratch_itr->prices;
+    }
+    const size_t chunk_begin = balances.size();
 
     // EOS smart contracts TVL
     for ( const name contract : contracts ) {
-        // liquid balance
-        for ( const auto token : _tokens ) {
-            const asset balance = get_balance_quantity( token.contract, contract, token.sym );
-            if ( balance.amount <= 0 ) continue;
-            balances.push_back( balance );
-
-            // price only used for logging purposes
-            prices.push_back( asset{ get_oracle_price( balance.symbol ), USD } );
-        }
-        // staked EOS (REX & delegated CPU/NET)
-        const asset staked = get_eos_staked( contract );
-        if ( staked.amount <= 0 ) continue;
-        balances.push_back( staked );
+        const uint16_t position = index++;
+        if ( position < cursor || position >= end ) continue; // outside of current chunk
 
-        // EOS price only used for logging purposes
-        prices.push_back( asset{ get_oracle_price( EOS ), USD } );
+        const name reason = add_contract_balances( context, contract, soft, balances );
+        if ( reason ) return reason;
     }
 
     // EVM smart contracts TVL
-    for ( const string evm_contract : evm_contracts ) {
-        for ( const auto evm_token : _evm_tokens ) {
-            const asset balance = get_evm_balance_quantity( evm_token.token_id, evm_contract, evm_token.sym );
-            if ( balance.amount <= 0 ) continue;
-            balances.push_back( balance );
-
-            // price only used for logging purposes
-            prices.push_back( asset{ get_oracle_price( balance.symbol ), USD } );
-        }
+    for ( const checksum160& evm_contract : evm_contracts ) {
+        const uint16_t position = index++;
+        if ( position < cursor || position >= end ) continue; // outside of current chunk
+
+        const name reason = add_evm_contract_balances( context, evm_contract, soft, balances );
+        if ( reason ) return reason;
     }
 
+    // skip protocol if any price of this chunk is invalid
+    for ( size_t i = chunk_begin; i < balances.size(); ++i ) {
+        if ( soft && !is_price_valid( balances[i].symbol ) ) return "price"_n;
+    }
+
+    // price only used for logging purposes
+    for ( size_t i = chunk_begin; i < balances.size(); ++i ) {
+        prices.push_back( asset{ get_oracle_price( balances[i].symbol ), USD } );
+    }
+
+    // persist partial balances until all chunks of the period are read
+    if ( end < total ) {
+        auto insert = [&]( auto& row ) {
+            row.protocol = protocol;
+            row.period = period;
+            row.contracts = contracts;
+            row.evm_contracts = evm_contracts;
+            row.cursor = end;
+            row.balances = balances;
+            row.prices = prices;
+        };
+        if ( scratch_itr == _scratch.end() ) _scratch.emplace( get_self(), insert );
+        else _scratch.modify( scratch_itr, get_self(), insert );
+        return "partial"_n;
+    }
+    if ( scratch_itr != _scratch.end() ) _scratch.erase( scratch_itr );
+
     // calculate USD valuation
     int64_t usd_amount = 0;
     for ( const asset balance : balances ) {
@@ -429,125 +642,386 @@ void oracle::update( const name oracle, const name protocol )
     const asset tvl = { eos, EOS };
     const asset usd = { usd_amount, USD };
 
+    // contracts are only stored when modified
+    const uint64_t version = set_contracts_version( protocol, category, contracts, evm_contracts, period );
+
+    // balances are only stored when modified (if change detection is enabled)
+    const time_point_sec balances_at = config.skip_unchanged.value() ? set_balances_fingerprint( protocol, period, version, balances, config.ring_buffer.value() ) : period;
+    const bool unchanged = balances_at != period;
+
     // add TVL to history
-    _periods.emplace( get_self(), [&]( auto& row ) {
+    auto insert = [&]( auto& row ) {
+        row.key = key;
         row.period = period;
-        row.protocol = protocol;
-        row.category = category;
-        row.contracts = contracts;
-        row.evm_contracts = evm_contracts;
-        row.balances = balances;
-        row.prices = prices;
+        row.version = version;
+        row.balances = unchanged ? vector<asset>{} : balances;
         row.tvl = tvl;
         row.usd = usd;
-    });
+        row.balances_at = balances_at;
+    };
+
+    // balances still referenced by a period of the last 24 hours are moved out of the overwritten ring buffer slot
+    if ( itr != _periods.end() && itr->period == get_referenced_balances_at( protocol, config.ring_buffer.value() ) ) {
+        const periods_row referenced = *itr;
+        _periods.emplace( get_self(), [&]( auto& row ) {
+            row = referenced;
+            row.key = referenced.period.sec_since_epoch();
+        });
+    }
 
-    // log update
-    oracle::updatelog_action updatelog( get_self(), { get_self(), "active"_n });
-    updatelog.send( oracle, protocol, category, contracts, evm_contracts, period, balances, prices, tvl, usd );
+    // overwrite ring buffer slot or create
+    if ( itr == _periods.end() ) _periods.emplace( get_self(), insert );
+    else _periods.modify( itr, get_self(), insert );
+
+    // log update (minimal log if balances are unchanged)
+    if ( unchanged ) {
+        oracle::unchangedlog_action unchangedlog( get_self(), { get_self(), "active"_n });
+        unchangedlog.send( context.oracle, protocol, period, balances_at, tvl, usd );
+    } else {
+        oracle::updatelog_action updatelog( get_self(), { get_self(), "active"_n });
+        updatelog.send( context.oracle, protocol, category, contracts, evm_contracts, period, balances, prices, tvl, usd );
+    }
 
     // prune last 24 hours
-    prune_protocol_periods( protocol );
+    prune_protocol_periods( protocol, config.ring_buffer.value() );
+
+    // add TVL to median buckets
+    add_median_datapoint( protocol, { period, tvl.amount, usd.amount } );
+
+    // report at the first sample once the report interval elapsed since the last report (sampling interval of the protocol if not configured)
+    // a missed sample delays the report to the next sample instead of the next interval boundary
+    const uint32_t sampling_interval = get_sampling_interval( config, protocol_itr->tvl );
+    const uint32_t report_interval = std::max( sampling_interval, config.report_interval.value() );
+    const uint32_t elapsed = period.sec_since_epoch() - protocol_itr->period_at.sec_since_epoch();
+    if ( elapsed >= report_interval ) generate_report( context, protocol, report_interval );
+    return {};
+}
+
+uint64_t oracle::get_oracle_slot( const name oracle, uint64_t& slots )
+{
+    oracle::oracles_table _oracles( get_self(), get_self().value );
+
+    // slots are assigned to active oracles ordered by name
+    uint64_t slot = 0;
+    slots = 0;
+    for ( const auto& row : _oracles ) {
+        if ( row.status != "active"_n ) continue;
+        if ( row.oracle == oracle ) slot = slots;
+        slots += 1;
+    }
+    check( slots, "oracle::get_oracle_slot: no active oracles");
+    return slot;
+}
+
+// returns period of the last balances change (current period if modified)
+time_point_sec oracle::set_balances_fingerprint( const name protocol, const time_point_sec period, const uint64_t version, const vector<asset>& balances, const bool ring_buffer )
+{
+    oracle::fingerprints_table _fingerprints( get_self(), get_self().value );
+    oracle::periods_table _periods( get_self(), protocol.value );
+
+    const std::vector<char> data = eosio::pack( std::make_tuple( version, balances ) );
+    const checksum256 fingerprint = sha256( data.data(), data.size() );
+
+    // referenced balances must still be stored (pruned after 24 hours or ring buffer slot overwritten)
+    auto itr = _fingerprints.find( protocol.value );
+    if ( itr != _fingerprints.end() && itr->fingerprint == fingerprint ) {
+        const bool is_retained = period.sec_since_epoch() - itr->balances_at.sec_since_epoch() < PERIOD_INTERVAL * MAX_PERIODS_REPORT;
+        auto period_itr = _periods.find( get_period_key( itr->balances_at, ring_buffer ) );
+        if ( is_retained && period_itr != _periods.end() && period_itr->period == itr->balances_at ) return itr->balances_at;
+    }
+
+    auto insert = [&]( auto& row ) {
+        row.protocol = protocol;
+        row.balances_at = period;
+        row.fingerprint = fingerprint;
+    };
+    if ( itr == _fingerprints.end() ) _fingerprints.emplace( get_self(), insert );
+    else _fingerprints.modify( itr, get_self(), insert );
+    return period;
+}
+
+uint64_t oracle::get_protocol_slot( const name protocol, const uint64_t slots )
+{
+    // mix name bits (names sharing a prefix share their upper bits)
+    uint64_t hash = protocol.value;
+    hash = ( hash ^ ( hash >> 33 ) ) * 0xff51afd7ed558ccdULL;
+    hash = ( hash ^ ( hash >> 33 ) ) * 0xc4ceb9fe1a85ec53ULL;
+    hash = hash ^ ( hash >> 33 );
+    return hash % slots;
+}
+
+uint32_t oracle::get_sampling_interval( const config_row& config, const asset tvl )
+{
+    if ( !config.tier_interval.value() ) return PERIOD_INTERVAL;
+    return tvl < config.tier_tvl.value() ? config.tier_interval.value() : PERIOD_INTERVAL;
+}
+
+uint32_t oracle::estimate_update_cost( const name oracle, const name protocol, const uint16_t contracts, const uint16_t evm_contracts, const uint32_t tokens, const uint32_t evm_tokens )
+{
+    // estimated cost from contracts & supported tokens
+    const uint32_t estimate = UPDATE_BASE_COST + contracts * ( CONTRACT_COST + tokens * TOKEN_COST ) + evm_contracts * evm_tokens * EVM_TOKEN_COST;
+
+    // observed cost recorded by the oracle's `calibrate` (bounded by the estimated cost)
+    oracle::costs_table _costs( get_self(), oracle.value );
+    auto itr = _costs.find( protocol.value );
+    if ( itr == _costs.end() ) return estimate;
+    return std::clamp( itr->cost, estimate / MAX_COST_DEVIATION, estimate * MAX_COST_DEVIATION );
+}
 
-    // report
-    generate_report( protocol, period );
+bool oracle::is_period_missed( const name protocol, const time_point_sec period, const uint32_t interval, const time_point_sec due_at, const time_point_sec period_at, const bool ring_buffer )
+{
+    // grace window after the due period (activation period if never scheduled) or last report, covers tier & report interval changes
+    const time_point_sec expected_at = std::max( due_at, period_at + interval );
+    if ( period < expected_at + FAILOVER_GRACE ) return false;
 
-    // update rewards
-    allocate_oracle_rewards( oracle );
+    oracle::periods_table _periods( get_self(), protocol.value );
+    const time_point_sec last_period = period - interval;
+    auto itr = _periods.find( get_period_key( last_period, ring_buffer ) );
+    return itr == _periods.end() || itr->period != last_period;
 }
 
-void oracle::allocate_oracle_rewards( const name oracle )
+uint16_t oracle::get_update_cursor( const name protocol, const time_point_sec period, const set<name>& contracts, const set<checksum160>& evm_contracts )
+{
+    oracle::scratch_table _scratch( get_self(), get_self().value );
+    auto itr = _scratch.find( protocol.value );
+
+    // restart if no partial update for this period or if contracts were modified
+    if ( itr == _scratch.end() || itr->period != period ) return 0;
+    if ( itr->contracts != contracts || itr->evm_contracts != evm_contracts ) return 0;
+    return itr->cursor;
+}
+
+void oracle::allocate_oracle_rewards( const config_row& config, const name oracle, const uint16_t updates )
 {
     oracle::oracles_table _oracles( get_self(), get_self().value );
-    auto config = get_config();
+    const asset rewards = config.reward_per_update.quantity * updates;
 
     auto & itr = _oracles.get(oracle.value, "oracle::add_oracle_rewards: [oracle] does not exists");
     _oracles.modify( itr, same_payer, [&]( auto& row ) {
-        row.balance += config.reward_per_update;
+        row.balance.quantity += rewards;
     });
 
     // logging
     oracle::rewardslog_action rewardslog( get_self(), { get_self(), "active"_n });
-    rewardslog.send( oracle, config.reward_per_update.quantity, itr.balance.quantity );
+    rewardslog.send( oracle, rewards, itr.balance.quantity );
 }
 
-void oracle::prune_protocol_periods( const name protocol )
+void oracle::prune_protocol_periods( const name protocol, const bool ring_buffer )
 {
     oracle::periods_table _periods( get_self(), protocol.value );
 
-    // TO-DO validate if pruning is still functional
+    // balances referenced by unchanged periods are kept until no period of the last 24 hours references them
+    const time_point_sec referenced_at = get_referenced_balances_at( protocol, ring_buffer );
+
+    // ring buffer slots are overwritten in place
+    // only erase periods stored before ring buffer was enabled (or moved out of their slot)
+    if ( ring_buffer ) {
+        auto itr = _periods.lower_bound( MAX_PERIODS_REPORT );
+        while ( itr != _periods.end() ) {
+            if ( itr->period == referenced_at ) itr++;
+            else itr = _periods.erase( itr );
+        }
+        return;
+    }
 
     // erase any periods that exceeds 24 hours
     const time_point_sec last_period = get_last_period( PERIOD_INTERVAL * MAX_PERIODS_REPORT );
     auto itr = _periods.begin();
-    while ( itr != _periods.end() ) {
-        if ( itr->period <= last_period ) itr = _periods.erase( itr ); // erase
-        if ( itr != _periods.end()) itr++; // continue
+    while ( itr != _periods.end() && itr->period <= last_period ) {
+        if ( itr->period == referenced_at ) itr++;
+        else itr = _periods.erase( itr );
+    }
+}
+
+// balances referenced by the oldest period of the last 24 hours (empty if none)
+// unchanged periods reference the last stored balances, newer periods never reference older balances
+time_point_sec oracle::get_referenced_balances_at( const name protocol, const bool ring_buffer )
+{
+    oracle::periods_table _periods( get_self(), protocol.value );
+
+    const time_point_sec last_period = get_last_period( PERIOD_INTERVAL * MAX_PERIODS_REPORT );
+    for ( uint32_t i = 1; i <= MAX_PERIODS_REPORT; ++i ) {
+        const time_point_sec period = last_period + PERIOD_INTERVAL * i;
+        auto itr = _periods.find( get_period_key( period, ring_buffer ) );
+        if ( itr != _periods.end() && itr->period == period ) return itr->balances_at;
     }
+    return {};
+}
+
+uint64_t oracle::set_contracts_version( const name protocol, const name category, const set<name> contracts, const set<checksum160> evm_contracts, const time_point_sec period )
+{
+    oracle::contracts_table _contracts( get_self(), protocol.value );
+
+    // latest version is re-used if contracts have not been modified
+    uint64_t version = 1;
+    if ( _contracts.begin() != _contracts.end() ) {
+        const auto last = _contracts.rbegin();
+        if ( last->category == category && last->contracts == contracts && last->evm_contracts == evm_contracts ) return last->version;
+        version = last->version + 1;
+    }
+
+    _contracts.emplace( get_self(), [&]( auto& row ) {
+        row.version = version;
+        row.period = period;
+        row.category = category;
+        row.contracts = contracts;
+        row.evm_contracts = evm_contracts;
+    });
+
+    // erase versions no longer referenced by any period of the last 24 hours
+    const time_point_sec last_period = get_last_period( PERIOD_INTERVAL * MAX_PERIODS_REPORT );
+    auto itr = _contracts.begin();
+    while ( itr != _contracts.end() ) {
+        const auto next = std::next( itr );
+        if ( next == _contracts.end() || next->period > last_period ) break;
+        itr = _contracts.erase( itr );
+    }
+    return version;
 }
 
 // generate report TVL to Yield+ Rewards
-void oracle::generate_report( const name protocol, const time_point_sec period )
+void oracle::generate_report( const update_context& context, const name protocol, const uint32_t report_interval )
 {
-    // yield config
-    auto config = get_config();
+    const time_point_sec period = context.period;
+    oracle::medians_table _medians( get_self(), get_self().value );
     asset tvl = { 0, EOS };
     asset usd = { 0, USD };
 
-    // slice values into 3 buckets of 8 hours each
-    uint64_t current_time_sec = current_time_point().sec_since_epoch();
-    uint64_t period_1 = current_time_sec - EIGHT_HOURS * 3;
-    uint64_t period_2 = period_1 + EIGHT_HOURS;
-    uint64_t period_3 = period_2 + EIGHT_HOURS;
-
-    // retrieve datapoint from timepoint
-    // skip generating report if any median contains no TVL
-    auto median_1 = get_median( protocol, period_1, period_2 );
-    if ( !median_1.tvl.amount ) return;
-
-    auto median_2 = get_median( protocol, period_2, period_3 );
-    if ( !median_2.tvl.amount ) return;
+    // buckets are shifted when datapoints are added
+    // retrieve median datapoint from each 8 hours bucket
+    // TVL is left empty (reschedule only) if any median contains no TVL
+    auto itr = _medians.find( protocol.value );
+    if ( itr != _medians.end() ) {
+        const uint32_t tier_interval = context.config.tier_interval.value();
+        const auto median_1 = get_median( itr->bucket_1, tier_interval );
+        const auto median_2 = get_median( itr->bucket_2, tier_interval );
+        const auto median_3 = get_median( itr->bucket_3, tier_interval );
+
+        // compute the average of the 3 windows median
+        if ( median_1.tvl && median_2.tvl && median_3.tvl ) {
+            tvl += (asset{ median_1.tvl, EOS } + asset{ median_2.tvl, EOS } + asset{ median_3.tvl, EOS } ) / 3;
+            usd += (asset{ median_1.usd, USD } + asset{ median_2.usd, USD } + asset{ median_3.usd, USD } ) / 3;
+        }
+    }
 
-    auto median_3 = get_median( protocol, period_3, current_time_sec );
-    if ( !median_3.tvl.amount ) return;
+    // queue report when updated from `updateall`
+    if ( context.batch_reports ) {
+        oracle::reports_table _reports( get_self(), get_self().value );
+        auto insert = [&]( auto& row ) {
+            row.protocol = protocol;
+            row.period = period;
+            row.period_interval = report_interval;
+            row.tvl = tvl;
+            row.usd = usd;
+        };
+        auto report_itr = _reports.find( protocol.value );
+        if ( report_itr == _reports.end() ) _reports.emplace( get_self(), insert );
+        else _reports.modify( report_itr, get_self(), insert );
+        return;
+    }
 
-    // compute the average of the 3 windows median
-    tvl += (median_1.tvl + median_2.tvl + median_3.tvl ) / 3;
-    usd += (median_1.usd + median_2.usd + median_3.usd ) / 3;
+    // not enough datapoints, move protocol to the next report period
+    if ( !tvl.amount ) {
+        yield::schedule_action schedule( context.config.yield_contract, { get_self(), "active"_n });
+        schedule.send( period, report_interval, vector<name>{ protocol } );
+        return;
+    }
 
     // send oracle report to Yield+ Rewards
-    yield::report_action report( config.yield_contract, { get_self(), "active"_n });
-    report.send( protocol, period, PERIOD_INTERVAL, tvl, usd );
+    yield::report_action report( context.config.yield_contract, { get_self(), "active"_n });
+    report.send( protocol, period, report_interval, tvl, usd );
 }
 
-oracle::periods_row oracle::get_median( const name protocol, const uint64_t period_start, const uint64_t period_end )
+oracle::datapoint oracle::get_median( const vector<datapoint>& bucket, const uint32_t tier_interval )
 {
-    oracle::periods_table _periods( get_self(), protocol.value );
+    // verify if the datapoints of each 8 hours window are within acceptable range, return if any is outside of the range
+    // minimum is the time covered by the datapoints (7 hours), buckets can mix sampling intervals after a tier change
+    const uint32_t count = bucket.size();
+    if ( get_bucket_coverage( bucket, tier_interval ) < MIN_BUCKET_PERIODS * PERIOD_INTERVAL || count > BUCKET_PERIODS ) return {};
+
+    // buckets are kept sorted by TVL, median datapoint is at the center
+    return bucket[count / 2];
+}
 
-    // find limit pointers
-    auto start = _periods.upper_bound(period_start);
-    auto end = _periods.upper_bound(period_end);
+// time covered by the datapoints of a bucket (seconds)
+// low TVL tier datapoints (`tier_interval` aligned & none within the previous `tier_interval`) cover `tier_interval`, others a single period
+uint32_t oracle::get_bucket_coverage( const vector<datapoint>& bucket, const uint32_t tier_interval )
+{
+    vector<uint32_t> periods;
+    for ( const datapoint& value : bucket ) periods.push_back( value.period.sec_since_epoch() );
+    std::sort( periods.begin(), periods.end() );
+
+    uint32_t coverage = 0;
+    for ( size_t i = 0; i < periods.size(); ++i ) {
+        const bool is_tier = tier_interval > PERIOD_INTERVAL && periods[i] % tier_interval == 0 && ( i == 0 || periods[i] - periods[i - 1] >= tier_interval );
+        coverage += is_tier ? tier_interval : PERIOD_INTERVAL;
+    }
+    return coverage;
+}
 
-    // calculate how many datapoints we have in each window of 8 hours
-    int count = std::distance(start, end);
+void oracle::add_median_datapoint( const name protocol, const datapoint value )
+{
+    oracle::medians_table _medians( get_self(), get_self().value );
+    const uint64_t current_time_sec = current_time_point().sec_since_epoch();
 
-    // verify if the number of datapoints for each 8 hours window is within acceptable range, return if any is outside of the range
-    if (count < MIN_BUCKET_PERIODS || count > BUCKET_PERIODS ) return {};
+    auto insert = [&]( auto& row ) {
+        row.protocol = protocol;
+        shift_median_buckets( row, current_time_sec );
+        insert_datapoint( row.bucket_3, value );
+    };
 
-    // add datapoints to vectors for sorting (first value is amount as uint64_t, second is datapoint time_point)
-    std::vector<std::pair<uint64_t, time_point>> datapoints;
-    for (int i = 0; i < count; i++) {
-        datapoints.push_back({ start->tvl.amount, start->period });
-        start++;
+    // modify or create
+    auto itr = _medians.find( protocol.value );
+    if ( itr != _medians.end() ) {
+        _medians.modify( itr, same_payer, insert );
+        return;
     }
 
-    // run a partial sort to find the median datapoint for each 8 hours window
-    int half = count / 2;
-    nth_element(datapoints.begin(), datapoints.begin() + half, datapoints.end());
-    auto median = datapoints[half];
+    // seed buckets from existing TVL history (ex: protocol updated before buckets existed)
+    oracle::periods_table _periods( get_self(), protocol.value );
+    _medians.emplace( get_self(), [&]( auto& row ) {
+        for ( const auto& period : _periods ) {
+            if ( period.period == value.period ) continue;
+            insert_datapoint( row.bucket_3, { period.period, period.tvl.amount, period.usd.amount } );
+        }
+        insert( row );
+    });
+}
 
-    // retrieve datapoint from timepoint
-    return _periods.get( median.second.sec_since_epoch() );
+void oracle::shift_median_buckets( medians_row& medians, const uint64_t current_time_sec )
+{
+    // slice values into 3 buckets of 8 hours each
+    const uint64_t period_1 = current_time_sec - EIGHT_HOURS * 3;
+    const uint64_t period_2 = period_1 + EIGHT_HOURS;
+    const uint64_t period_3 = period_2 + EIGHT_HOURS;
+
+    // datapoints cascade into older buckets, evicted after 24 hours
+    move_datapoints( medians.bucket_3, &medians.bucket_2, period_3 );
+    move_datapoints( medians.bucket_2, &medians.bucket_1, period_2 );
+    move_datapoints( medians.bucket_1, nullptr, period_1 );
+}
+
+void oracle::move_datapoints( vector<datapoint>& from, vector<datapoint>* to, const uint64_t boundary )
+{
+    auto itr = from.begin();
+    while ( itr != from.end() ) {
+        if ( itr->period.sec_since_epoch() > boundary ) {
+            itr++;
+            continue;
+        }
+        if ( to ) insert_datapoint( *to, *itr );
+        itr = from.erase( itr );
+    }
+}
+
+void oracle::insert_datapoint( vector<datapoint>& bucket, const datapoint value )
+{
+    // sorted by TVL amount, ties are sorted by period
+    const auto itr = std::lower_bound( bucket.begin(), bucket.end(), value, []( const datapoint& a, const datapoint& b ) {
+        if ( a.tvl != b.tvl ) return a.tvl < b.tvl;
+        return a.period < b.period;
+    });
+    bucket.insert( itr, value );
 }
 
 // @system
@@ -563,6 +1037,193 @@ void oracle::setreward( const asset reward_per_update )
     _config.set(config, get_self());
 }
 
+// @system
+[[eosio::action]]
+void oracle::setstorage( const bool ring_buffer )
+{
+    require_auth( get_self() );
+
+    oracle::config_table _config( get_self(), get_self().value );
+    auto config = get_config();
+    check( config.ring_buffer.value() != ring_buffer, "oracle::setstorage: [ring_buffer] was not modified");
+    config.ring_buffer = ring_buffer;
+    _config.set(config, get_self());
+}
+
+// @system
+[[eosio::action]]
+void oracle::setbudget( const uint32_t update_budget )
+{
+    require_auth( get_self() );
+
+    oracle::config_table _config( get_self(), get_self().value );
+    auto config = get_config();
+    check( config.update_budget.value() != update_budget, "oracle::setbudget: [update_budget] was not modified");
+    config.update_budget = update_budget;
+    _config.set(config, get_self());
+}
+
+// @system
+[[eosio::action]]
+void oracle::settier( const asset tier_tvl, const uint32_t tier_interval )
+{
+    require_auth( get_self() );
+
+    oracle::config_table _config( get_self(), get_self().value );
+    auto config = get_config();
+    check( tier_tvl.symbol == EOS, "oracle::settier: [tier_tvl] does not match EOS symbol");
+    check( tier_interval % PERIOD_INTERVAL == 0, "oracle::settier: [tier_interval] must be a multiple of 10 minutes");
+    check( !tier_interval || EIGHT_HOURS % tier_interval == 0, "oracle::settier: [tier_interval] must divide 8 hours");
+    check( !tier_interval || config.report_interval.value() % tier_interval == 0, "oracle::settier: [tier_interval] must divide [report_interval]");
+    config.tier_tvl = tier_tvl;
+    config.tier_interval = tier_interval;
+    _config.set(config, get_self());
+}
+
+// @system
+[[eosio::action]]
+void oracle::setreport( const uint32_t report_interval )
+{
+    require_auth( get_self() );
+
+    oracle::config_table _config( get_self(), get_self().value );
+    auto config = get_config();
+    check( report_interval % PERIOD_INTERVAL == 0, "oracle::setreport: [report_interval] must be a multiple of 10 minutes");
+    check( !report_interval || EIGHT_HOURS % report_interval == 0, "oracle::setreport: [report_interval] must divide 8 hours");
+    check( !config.tier_interval.value() || report_interval % config.tier_interval.value() == 0, "oracle::setreport: [report_interval] must be a multiple of [tier_interval]");
+    check( config.report_interval.value() != report_interval, "oracle::setreport: [report_interval] was not modified");
+    config.report_interval = report_interval;
+    _config.set(config, get_self());
+}
+
+// @system
+[[eosio::action]]
+void oracle::setskip( const bool skip_unchanged )
+{
+    require_auth( get_self() );
+
+    oracle::config_table _config( get_self(), get_self().value );
+    auto config = get_config();
+    check( config.skip_unchanged.value() != skip_unchanged, "oracle::setskip: [skip_unchanged] was not modified");
+    config.skip_unchanged = skip_unchanged;
+    _config.set(config, get_self());
+
+    // fingerprints are outdated once change detection is disabled
+    if ( !skip_unchanged ) {
+        oracle::fingerprints_table _fingerprints( get_self(), get_self().value );
+        auto itr = _fingerprints.begin();
+        while ( itr != _fingerprints.end() ) itr = _fingerprints.erase( itr );
+    }
+}
+
+// @oracle
+[[eosio::action]]
+void oracle::calibrate( const name oracle, const name protocol, const uint32_t cost )
+{
+    require_auth( oracle );
+    check_oracle_active( oracle );
+
+    auto config = get_config();
+    oracle::costs_table _costs( get_self(), oracle.value );
+    yield::protocols_table _protocols( config.yield_contract, config.yield_contract.value );
+    check( _protocols.find( protocol.value ) != _protocols.end(), "oracle::calibrate: [protocol] does not exists");
+    check( cost, "oracle::calibrate: [cost] must be above 0");
+
+    // moving average of observed costs (1/4 weight to latest observation)
+    auto itr = _costs.find( protocol.value );
+    auto insert = [&]( auto& row ) {
+        row.protocol = protocol;
+        row.cost = itr == _costs.end() ? cost : ( uint64_t{ row.cost } * 3 + cost ) / 4;
+        row.calibrated_at = current_time_point();
+    };
+    if ( itr == _costs.end() ) _costs.emplace( get_self(), insert );
+    else _costs.modify( itr, get_self(), insert );
+}
+
+// @system
+[[eosio::action]]
+void oracle::migrate( const name protocol, const optional<uint16_t> max_rows )
+{
+    require_auth( get_self() );
+
+    oracle::legacy_periods_table _legacy_periods( get_self(), protocol.value );
+    oracle::periods_table _periods( get_self(), protocol.value );
+    oracle::medians_table _medians( get_self(), get_self().value );
+    check( _legacy_periods.begin() != _legacy_periods.end(), "oracle::migrate: [protocol] has no legacy periods");
+
+    int limit = max_rows ? *max_rows : 50;
+    check( limit, "oracle::migrate: [max_rows] must be above 0");
+
+    const auto config = get_config();
+    const bool ring_buffer = config.ring_buffer.value();
+    const time_point_sec last_period = get_last_period( PERIOD_INTERVAL * MAX_PERIODS_REPORT );
+    vector<datapoint> datapoints;
+
+    // legacy periods cannot be replayed after newer periods or contracts versions (`update` resumed before `migrate`)
+    const time_point_sec legacy_at = _legacy_periods.rbegin()->period;
+    if ( legacy_at > last_period ) {
+        oracle::contracts_table _contracts( get_self(), protocol.value );
+        for ( const auto& row : _periods ) {
+            check( row.period <= legacy_at, "oracle::migrate: [periods.v2] has periods newer than legacy periods");
+        }
+        check( _contracts.begin() == _contracts.end() || _contracts.rbegin()->period <= legacy_at, "oracle::migrate: [contracts] has versions newer than legacy periods");
+    }
+
+    auto itr = _legacy_periods.begin();
+    while ( itr != _legacy_periods.end() && limit-- > 0 ) {
+        // only periods of the last 24 hours are moved (unless a newer period was already stored)
+        const uint64_t key = get_period_key( itr->period, ring_buffer );
+        auto period_itr = _periods.find( key );
+        const bool is_stored = period_itr != _periods.end() && period_itr->period >= itr->period;
+        if ( itr->period > last_period && !is_stored ) {
+            set<checksum160> evm_contracts;
+            for ( const string& evm_contract : itr->evm_contracts ) {
+                const optional<bytes> address = silkworm::from_hex( evm_contract );
+                if ( address && address->size() == 20 ) evm_contracts.insert( evm_contract::to_address( *address ) );
+            }
+            const uint64_t version = set_contracts_version( protocol, itr->category, itr->contracts, evm_contracts, itr->period );
+            auto insert = [&]( auto& row ) {
+                row.key = key;
+                row.period = itr->period;
+                row.version = version;
+                row.balances = itr->balances;
+                row.tvl = itr->tvl;
+                row.usd = itr->usd;
+                row.balances_at = itr->period;
+            };
+            if ( period_itr == _periods.end() ) _periods.emplace( get_self(), insert );
+            else _periods.modify( period_itr, get_self(), insert );
+            datapoints.push_back( { itr->period, itr->tvl.amount, itr->usd.amount } );
+        }
+        itr = _legacy_periods.erase( itr );
+    }
+
+    // median buckets are seeded from `periods.v2` when created, existing buckets receive the moved periods
+    auto medians_itr = _medians.find( protocol.value );
+    if ( medians_itr == _medians.end() || datapoints.empty() ) return;
+    _medians.modify( medians_itr, same_payer, [&]( auto& row ) {
+        for ( const datapoint& value : datapoints ) {
+            insert_datapoint( row.bucket_3, value );
+        }
+        shift_median_buckets( row, current_time_point().sec_since_epoch() );
+    });
+}
+
+// @system
+[[eosio::action]]
+void oracle::setmulticall( const bytes multicall )
+{
+    require_auth( get_self() );
+
+    oracle::config_table _config( get_self(), get_self().value );
+    auto config = get_config();
+    check( multicall.empty() || multicall.size() == 20, "oracle::setmulticall: [multicall] must be 20 bytes");
+    check( multicall.empty() || evm_contract::is_account( multicall ), "oracle::setmulticall: [multicall] does not exists");
+    check( config.multicall.value() != multicall, "oracle::setmulticall: [multicall] was not modified");
+    config.multicall = multicall;
+    _config.set(config, get_self());
+}
+
 time_point_sec oracle::get_current_period( const uint32_t period_interval )
 {
     const uint32_t now = current_time_point().sec_since_epoch();
@@ -575,15 +1236,60 @@ time_point_sec oracle::get_last_period( const uint32_t last )
     return time_point_sec( current - last );
 }
 
-asset oracle::get_balance_quantity( const name token_contract_account, const name owner, const symbol sym )
+uint64_t oracle::get_period_key( const time_point_sec period, const bool ring_buffer )
+{
+    if ( ring_buffer ) return period.sec_since_epoch() / PERIOD_INTERVAL % MAX_PERIODS_REPORT;
+    return period.sec_since_epoch();
+}
+
+// returns empty if balance symbol does not match
+optional<asset> oracle::find_balance_quantity( const name token_contract_account, const name owner, const symbol sym )
 {
     eosio::token::accounts _accounts( token_contract_account, owner.value );
     const auto itr = _accounts.find( sym.code().raw() );
-    if ( itr == _accounts.end() ) return { 0, sym };
-    check( itr->balance.symbol == sym, "oracle::get_balance_amount: [sym] does not match");
+    if ( itr == _accounts.end() ) return asset{ 0, sym };
+    if ( itr->balance.symbol != sym ) return {};
     return itr->balance;
 }
 
+vector<extended_symbol> oracle::get_holdings( const name contract )
+{
+    oracle::holdings_table _holdings( get_self(), get_self().value );
+    oracle::state_table _state( get_self(), get_self().value );
+    const time_point_sec now = current_time_point();
+
+    // use existing holdings unless expired or supported tokens were modified (including within the same second)
+    // contracts without holdings are refreshed at each update (first supported token received is counted immediately)
+    auto itr = _holdings.find( contract.value );
+    const bool is_exists = itr != _holdings.end();
+    if ( is_exists ) {
+        const bool is_expired = itr->refreshed_at.sec_since_epoch() + HOLDINGS_INTERVAL <= now.sec_since_epoch();
+        const bool is_modified = itr->refreshed_at <= _state.get_or_default().tokens_at;
+        if ( !is_expired && !is_modified && itr->tokens.size() ) return itr->tokens;
+    }
+
+    // refresh from all supported tokens
+    oracle::tokens_table _tokens( get_self(), get_self().value );
+    vector<extended_symbol> tokens;
+    for ( const auto token : _tokens ) {
+        eosio::token::accounts _accounts( token.contract, contract.value );
+        if ( _accounts.find( token.sym.code().raw() ) == _accounts.end() ) continue;
+        tokens.push_back( extended_symbol{ token.sym, token.contract } );
+    }
+    if ( is_exists && tokens.empty() && itr->tokens.empty() ) return tokens; // still no holdings
+
+    auto insert = [&]( auto& row ) {
+        row.contract = contract;
+        row.tokens = tokens;
+        row.refreshed_at = now;
+    };
+
+    // modify or create
+    if ( is_exists ) _holdings.modify( itr, get_self(), insert );
+    else _holdings.emplace( get_self(), insert );
+    return tokens;
+}
+
 asset oracle::get_eos_staked( const name owner )
 {
     eosiosystem::voters_table _voter( "eosio"_n, "eosio"_n.value );
@@ -592,49 +1298,195 @@ asset oracle::get_eos_staked( const name owner )
     return { itr->staked, EOS };
 }
 
+// adds balances held by EOS contract, read once per batch (shared by protocols listing the same contract)
+// returns skip reason if balances cannot be read (`soft` mode, asserts otherwise)
+name oracle::add_contract_balances( update_context& context, const name contract, const bool soft, vector<asset>& balances )
+{
+    auto itr = context.balances.find( contract );
+    if ( itr == context.balances.end() ) {
+        vector<asset> contract_balances;
+
+        // valued by a previous `update` of the period (other batch or oracle)
+        oracle::snapshots_table _snapshots( get_self(), contract.value );
+        auto snapshot_itr = _snapshots.find( context.period.sec_since_epoch() );
+        if ( snapshot_itr != _snapshots.end() ) contract_balances = snapshot_itr->balances;
+        else {
+            // liquid balance (only supported tokens held by contract)
+            for ( const extended_symbol token : get_holdings( contract ) ) {
+                const optional<asset> balance = find_balance_quantity( token.get_contract(), contract, token.get_symbol() );
+                if ( !balance ) {
+                    check( soft, "oracle::get_balance_amount: [sym] does not match");
+                    return "symbol"_n;
+                }
+                if ( balance->amount <= 0 ) continue;
+                contract_balances.push_back( *balance );
+            }
+            // staked EOS (REX & delegated CPU/NET)
+            const asset staked = get_eos_staked( contract );
+            if ( staked.amount > 0 ) contract_balances.push_back( staked );
+            set_balances_snapshot( _snapshots, context.period, contract_balances );
+        }
+        itr = context.balances.emplace( contract, contract_balances ).first;
+    }
+    balances.insert( balances.end(), itr->second.begin(), itr->second.end() );
+    return {};
+}
+
+// adds balances held by EOS EVM contract, read once per batch (shared by protocols listing the same address)
+// returns skip reason if balances cannot be read (`soft` mode, asserts otherwise)
+template <typename T>
+void oracle::set_balances_snapshot( T& snapshots, const time_point_sec period, const vector<asset>& balances )
+{
+    // erase snapshots of previous periods (only shared within the period)
+    auto itr = snapshots.begin();
+    while ( itr != snapshots.end() && itr->period < period ) {
+        itr = snapshots.erase( itr );
+    }
+
+    snapshots.emplace( get_self(), [&]( auto& row ) {
+        row.period = period;
+        row.balances = balances;
+    });
+}
+
+name oracle::add_evm_contract_balances( update_context& context, const checksum160& address, const bool soft, vector<asset>& balances )
+{
+    auto itr = context.evm_balances.find( address );
+    if ( itr == context.evm_balances.end() ) {
+        vector<asset> contract_balances;
+
+        const bytes address_bytes = evm_contract::to_bytes( address );
+        const optional<uint64_t> address_id = find_evm_account_id( address_bytes );
+        if ( !address_id ) {
+            check( soft, "oracle::get_evm_account_id: [address=" + silkworm::to_hex( address_bytes, true ) + "] account not found");
+            return "evmaccount"_n;
+        }
+
+        // valued by a previous `update` of the period (other batch or oracle)
+        oracle::evm_snapshots_table _snapshots( get_self(), *address_id );
+        auto snapshot_itr = _snapshots.find( context.period.sec_since_epoch() );
+        if ( snapshot_itr != _snapshots.end() ) contract_balances = snapshot_itr->balances;
+        else {
+            for ( const auto& evm_token : context.evm_tokens ) {
+                const optional<asset> balance = find_evm_balance_quantity( evm_token.token_id, *address_id, evm_token.sym );
+                if ( !balance ) {
+                    check( soft, "oracle::get_evm_balance_quantity: [sym] does not match");
+                    return "symbol"_n;
+                }
+                if ( balance->amount <= 0 ) continue;
+                contract_balances.push_back( *balance );
+            }
+            set_balances_snapshot( _snapshots, context.period, contract_balances );
+        }
+        itr = context.evm_balances.emplace( address, contract_balances ).first;
+    }
+    balances.insert( balances.end(), itr->second.begin(), itr->second.end() );
+    return {};
+}
+
 int64_t oracle::calculate_usd_value( const asset quantity )
 {
-    const int64_t price = get_oracle_price( quantity.symbol );
-    return quantity.amount * price / pow(10, quantity.symbol.precision());
+    const auto price = fixed::decimal<PRECISION>::from_raw( get_oracle_price( quantity.symbol ) );
+    return ( price * quantity.amount / fixed::pow10( quantity.symbol.precision() ) ).amount();
 }
 
 int64_t oracle::convert_usd_to_eos( const int64_t usd )
 {
-    const int64_t price = get_oracle_price( EOS );
-    return usd * pow( 10, PRECISION ) / price;
+    const auto price = fixed::decimal<PRECISION>::from_raw( get_oracle_price( EOS ) );
+    return ( fixed::decimal<PRECISION>::from_raw( usd ) / price ).amount();
 }
 
 int64_t oracle::get_oracle_price( const symbol sym )
+{
+    string error;
+    const int64_t price = set_oracle_price( sym, error );
+    check( price > 0, error );
+    return price;
+}
+
+bool oracle::is_price_valid( const symbol sym )
+{
+    // a valid price is stored as the snapshot of the period, reused by `get_oracle_price`
+    string error;
+    return set_oracle_price( sym, error ) > 0;
+}
+
+// returns 0 (with error) if price is invalid, otherwise stores the price snapshot of the current period
+int64_t oracle::set_oracle_price( const symbol sym, string& error )
 {
     // stable tokens uses fixed prices = 1.0000 USD
     if ( is_stable( sym ) ) return 10000;
 
+    // price snapshot is shared by every update within the same period
+    oracle::prices_table _prices( get_self(), sym.code().raw() );
+    const time_point_sec period = get_current_period( PERIOD_INTERVAL );
+    auto itr = _prices.find( period.sec_since_epoch() );
+    if ( itr != _prices.end() ) {
+        if ( itr->sym == sym ) return itr->price.amount;
+        error = "oracle::get_oracle_price: [symbol] does not match price snapshot";
+        return 0;
+    }
+
+    // first request of the period computes & validates price from oracles
+    const int64_t price = find_oracle_price( sym, error );
+    if ( price <= 0 ) return 0;
+
+    // erase any price snapshots that exceeds 24 hours
+    const time_point_sec last_period = get_last_period( PERIOD_INTERVAL * MAX_PERIODS_REPORT );
+    auto prune_itr = _prices.begin();
+    while ( prune_itr != _prices.end() && prune_itr->period <= last_period ) {
+        prune_itr = _prices.erase( prune_itr );
+    }
+
+    _prices.emplace( get_self(), [&]( auto& row ) {
+        row.period = period;
+        row.sym = sym;
+        row.price = asset{ price, USD };
+    });
+    return price;
+}
+
+// returns 0 (with error) if price is invalid
+int64_t oracle::find_oracle_price( const symbol sym, string& error )
+{
     oracle::tokens_table _tokens( get_self(), get_self().value );
-    const symbol_code symcode = sym.code();
-    auto token = _tokens.get( symcode.raw(), "oracle::get_oracle_price: [symbol] does not exists");
-    check(token.sym == sym, "oracle::get_oracle_price: [symbol] does not match token");
+    auto token = _tokens.find( sym.code().raw() );
+    if ( token == _tokens.end() ) {
+        error = "oracle::calculate_oracle_price: [symbol] does not exists";
+        return 0;
+    }
+    if ( token->sym != sym ) {
+        error = "oracle::calculate_oracle_price: [symbol] does not match token";
+        return 0;
+    }
 
     // Defibox Oracle
-    const int64_t price1 = get_defibox_price( *token.defibox_oracle_id );
+    const int64_t price1 = get_defibox_price( *token->defibox_oracle_id );
 
     // Delphi Oracle
-    const int64_t price2 = get_delphi_price( *token.delphi_oracle_id );
+    const int64_t price2 = get_delphi_price( *token->delphi_oracle_id );
 
     // in case oracles do not exists
     if ( !price2 && price1 ) return price1;
     if ( !price1 && price2 ) return price2;
 
     // TO-DO add price variations checks
-    check( price1 && price2, "oracle::get_oracle_price: invalid prices");
+    if ( !price1 && !price2 ) {
+        error = "oracle::calculate_oracle_price: invalid prices";
+        return 0;
+    }
     const int64_t average = ( price1 + price2 ) / 2;
 
-    // assert if price deviates from average price
-    check( average * (10000 + MAX_PRICE_DEVIATION) / 10000 > price1, "oracle::get_oracle_price: invalid oracle prices, [price1] exceeds deviation");
-    check( average * (10000 + MAX_PRICE_DEVIATION) / 10000 > price2, "oracle::get_oracle_price: invalid oracle prices, [price2] exceeds deviation");
-    check( average * (10000 - MAX_PRICE_DEVIATION) / 10000 < price1, "oracle::get_oracle_price: invalid oracle prices, [price1] below deviation");
-    check( average * (10000 - MAX_PRICE_DEVIATION) / 10000 < price2, "oracle::get_oracle_price: invalid oracle prices, [price2] below deviation");
+    // invalid if price deviates from average price
+    const auto upper = fixed::decimal<PRECISION>::from_raw( average ) * (10000 + MAX_PRICE_DEVIATION) / 10000;
+    const auto lower = fixed::decimal<PRECISION>::from_raw( average ) * (10000 - MAX_PRICE_DEVIATION) / 10000;
+    if ( upper.value <= price1 ) error = "oracle::calculate_oracle_price: invalid oracle prices, [price1] exceeds deviation";
+    else if ( upper.value <= price2 ) error = "oracle::calculate_oracle_price: invalid oracle prices, [price2] exceeds deviation";
+    else if ( lower.value >= price1 ) error = "oracle::calculate_oracle_price: invalid oracle prices, [price1] below deviation";
+    else if ( lower.value >= price2 ) error = "oracle::calculate_oracle_price: invalid oracle prices, [price2] below deviation";
+    if ( error.size() ) return 0;
 
-    return ( price1 + price2 ) / 2;
+    return average;
 }
 
 int64_t oracle::get_delphi_price( const name delphi_oracle_id )
@@ -658,7 +1510,7 @@ int64_t oracle::get_defibox_price( const uint64_t defibox_oracle_id )
 
 int64_t oracle::normalize_price( const int64_t price, const uint8_t precision )
 {
-    return price * pow(10, PRECISION) / pow(10, precision);
+    return fixed::decimal<PRECISION>::from_amount( price, precision ).amount();
 }
 
 oracle::config_row oracle::get_config()
@@ -684,6 +1536,14 @@ void oracle::require_auth_admin( const name account )
     require_auth( account );
 }
 
+void oracle::set_tokens_modified()
+{
+    oracle::state_table _state( get_self(), get_self().value );
+    auto state = _state.get_or_default();
+    state.tokens_at = current_time_point();
+    _state.set(state, get_self());
+}
+
 bool oracle::is_stable( const symbol sym )
 {
     return sym == USDT || sym == USDC || sym == USD;
@@ -4,10 +4,9 @@
 #include <eosio/asset.hpp>
 #include <eosio/system.hpp>
 #include <eosio/singleton.hpp>
+#include <eosio/crypto.hpp>
 #include <eosio.yield/eosio.yield.hpp>
 
-#include <math.h>
-
 using namespace eosio;
 using namespace std;
 
@@ -35,17 +34,34 @@ public:
     const uint32_t MIN_BUCKET_PERIODS = 42; // 7 hours (42 periods);
     const uint32_t MAX_PERIODS_REPORT = 144; // 24 hours (144 periods)
     const uint32_t PERIOD_INTERVAL = TEN_MINUTES;
-    const uint8_t PRECISION = 4;
-    const double MAX_PRICE_DEVIATION = 1000; // 10% (below & above average price)
+    const uint32_t HOLDINGS_INTERVAL = 3600; // 1 hour (6 periods)
+    const uint16_t UPDATE_CHUNK_SIZE = 4; // contracts (EOS & EVM) read per `update` action
+    const uint32_t FAILOVER_GRACE = 1800; // 30 minutes (3 periods) overdue before any oracle can update a protocol
+    const uint32_t UPDATE_BASE_COST = 200; // estimated CPU (us) per protocol update
+    const uint32_t CONTRACT_COST = 150; // estimated CPU (us) per EOS contract (staked EOS)
+    const uint32_t TOKEN_COST = 40; // estimated CPU (us) per supported token of each EOS contract
+    const uint32_t EVM_TOKEN_COST = 60; // estimated CPU (us) per EVM token of each EVM contract
+    const uint32_t MAX_COST_DEVIATION = 2; // calibrated cost is bounded between half & double the estimated cost
+    static constexpr uint8_t PRECISION = 4;
+    const int64_t MAX_PRICE_DEVIATION = 1000; // 10% (below & above average price)
 
     /**
      * ## TABLE `config`
      *
+     * > Fields after `admin_contract` are binary extensions (config written before they existed remains readable)
+     *
      * ### params
      *
      * - `{extended_asset} reward_per_update` - reward per update (ex: "0.0200 EOS")
      * - `{name} yield_contract` - Yield+ core contract
      * - `{name} admin_contract` - Yield+ admin contract
+     * - `{bool} ring_buffer=false` - store periods in fixed ring buffer slots
+     * - `{bytes} multicall` - EOS EVM multicall contract used to batch `balanceOf` reads (empty = disabled)
+     * - `{uint32_t} update_budget=0` - estimated CPU budget (us) of protocols packed by `updateall` (0 = disabled)
+     * - `{asset} tier_tvl` - protocols with a reported TVL below this value are sampled every `tier_interval`
+     * - `{uint32_t} tier_interval=0` - sampling interval (seconds) of the low TVL tier (0 = disabled, every protocol is sampled each period)
+     * - `{uint32_t} report_interval=0` - minimum interval (seconds) between medians & reports sent to Yield+ (0 = reported at each sample)
+     * - `{bool} skip_unchanged=false` - balances identical to the previous period are not stored again (see `fingerprints` table)
      *
      * ### example
      *
@@ -53,17 +69,54 @@ public:
      * {
      *     "reward_per_update": {"contract": "eosio.token", "quantity": "0.0200 EOS"},
      *     "yield_contract": "eosio.yield",
-     *     "admin_contract": "admin.yield"
+     *     "admin_contract": "admin.yield",
+     *     "ring_buffer": false,
+     *     "multicall": "ca11bde05977b3631167028862be2a173976ca11",
+     *     "update_budget": 30000,
+     *     "tier_tvl": "1000000.0000 EOS",
+     *     "tier_interval": 3600,
+     *     "report_interval": 3600,
+     *     "skip_unchanged": false
      * }
      * ```
      */
     struct [[eosio::table("config")]] config_row {
-        extended_asset          reward_per_update;
-        name                    yield_contract = "eosio.yield"_n;
-        name                    admin_contract = "admin.yield"_n;
+        extended_asset              reward_per_update;
+        name                        yield_contract = "eosio.yield"_n;
+        name                        admin_contract = "admin.yield"_n;
+        binary_extension<bool>      ring_buffer = false;
+        binary_extension<bytes>     multicall = bytes{};
+        binary_extension<uint32_t>  update_budget = 0;
+        binary_extension<asset>     tier_tvl = asset{};
+        binary_extension<uint32_t>  tier_interval = 0;
+        binary_extension<uint32_t>  report_interval = 0;
+        binary_extension<bool>      skip_unchanged = false;
     };
     typedef eosio::singleton< "config"_n, config_row > config_table;
 
+    /**
+     * ## TABLE `state`
+     *
+     * ### params
+     *
+     * - `{time_point_sec} tokens_at` - last time supported tokens were modified
+     * - `{bool} batch_reports` - reports are queued until `flushreports` (set by `updateall`)
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "tokens_at": "2022-05-13T00:00:00",
+     *     "batch_reports": false
+     * }
+     * ```
+     */
+    struct [[eosio::table("state")]] state_row {
+        time_point_sec          tokens_at;
+        bool                    batch_reports = false;
+    };
+    typedef eosio::singleton< "state"_n, state_row > state_table;
+
     /**
      * ## TABLE `tokens`
      *
@@ -98,6 +151,38 @@ public:
     };
     typedef eosio::multi_index< "tokens"_n, tokens_row> tokens_table;
 
+    /**
+     * ## TABLE `holdings`
+     *
+     * > Supported tokens held by a protocol contract (refreshed every hour, when supported tokens are modified or while the contract holds none)
+     *
+     * A supported token received by a contract that already holds other supported tokens is counted after the next hourly refresh.
+     *
+     * ### params
+     *
+     * - `{name} contract` - (primary key) EOS contract
+     * - `{vector<extended_symbol>} tokens` - supported tokens held by contract
+     * - `{time_point_sec} refreshed_at` - last time holdings were refreshed
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "contract": "myprotocol",
+     *     "tokens": [{"sym": "4,EOS", "contract": "eosio.token"}, {"sym": "4,USDT", "contract": "tethertether"}],
+     *     "refreshed_at": "2022-05-13T00:00:00"
+     * }
+     * ```
+     */
+    struct [[eosio::table("holdings")]] holdings_row {
+        name                        contract;
+        vector<extended_symbol>     tokens;
+        time_point_sec              refreshed_at;
+
+        uint64_t primary_key() const { return contract.value; }
+    };
+    typedef eosio::multi_index< "holdings"_n, holdings_row> holdings_table;
+
     /**
      * ## TABLE `evm.tokens`
      *
@@ -167,9 +252,223 @@ public:
     };
     typedef eosio::multi_index< "evm.balances"_n, evm_balances_row> evm_balances_table;
 
+    /**
+     * ## TABLE `evm.accounts`
+     *
+     * > Cache of resolved `eosio.evm` account IDs (populated on first lookup)
+     *
+     * ### params
+     *
+     * - `{uint64_t} key` - (primary key) first 8 bytes of EOS EVM address
+     * - `{bytes} address` - EOS EVM address
+     * - `{uint64_t} account_id` - `eosio.evm` account ID
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "key": "7429354029422253605",
+     *     "address": "671A5e209A5496256ee21386EC3EaB9054d658A2",
+     *     "account_id": 663
+     * }
+     * ```
+     */
+    struct [[eosio::table("evm.accounts")]] evm_accounts_row {
+        uint64_t                key;
+        bytes                   address;
+        uint64_t                account_id;
+
+        uint64_t primary_key() const { return key; }
+    };
+    typedef eosio::multi_index< "evm.accounts"_n, evm_accounts_row> evm_accounts_table;
+
+    /**
+     * ## TABLE `requests`
+     *
+     * > Pending EOS EVM requests (`balanceof` & `balancesof`), consumed by the `callback` & `callbackall` actions
+     *
+     * `eosio.evm` sends callbacks inline without authorization, the request ID is appended to the callback context
+     * and callbacks are rejected unless they match a pending request.
+     *
+     * ### params
+     *
+     * - `{uint64_t} request_id` - (primary key) request ID (last 8 bytes of the callback context)
+     * - `{checksum256} hash` - sha256 of the callback context (without request ID)
+     * - `{time_point_sec} requested_at` - request time
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "request_id": 0,
+     *     "hash": "6a0b2e4c1f0f4c3a9b6f8d7e5c4b3a291807f6e5d4c3b2a1908f7e6d5c4b3a29",
+     *     "requested_at": "2022-05-13T00:00:00"
+     * }
+     * ```
+     */
+    struct [[eosio::table("requests")]] requests_row {
+        uint64_t                request_id;
+        checksum256             hash;
+        time_point_sec          requested_at;
+
+        uint64_t primary_key() const { return request_id; }
+    };
+    typedef eosio::multi_index< "requests"_n, requests_row> requests_table;
+
+    /**
+     * ## TABLE `prices`
+     *
+     * > Validated price of the period (stored by the first valid price check, reused by every later update of the period)
+     *
+     * - scope: `{symbol_code} symcode`
+     *
+     * ### params
+     *
+     * - `{time_point_sec} period` - (primary key) period at time
+     * - `{symbol} sym` - token symbol
+     * - `{asset} price` - validated oracle price in USD
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "period": "2022-05-13T00:00:00",
+     *     "sym": "4,EOS",
+     *     "price": "1.5000 USD"
+     * }
+     * ```
+     */
+    struct [[eosio::table("prices")]] prices_row {
+        time_point_sec          period;
+        symbol                  sym;
+        asset                   price;
+
+        uint64_t primary_key() const { return period.sec_since_epoch(); }
+    };
+    typedef eosio::multi_index< "prices"_n, prices_row> prices_table;
+
+    /**
+     * ## TABLE `snapshots`
+     *
+     * > Balances of a contract within the current period, shared by every `update` of the period (other batches & oracles)
+     *
+     * - scope: `{name} contract` (`evm.snapshots` table scoped by `{uint64_t} address_id` for EOS EVM contracts)
+     *
+     * Snapshots of previous periods are erased when the contract is valued again.
+     *
+     * ### params
+     *
+     * - `{time_point_sec} period` - (primary key) period at time
+     * - `{vector<asset>} balances` - supported token balances & staked EOS of the contract
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "period": "2022-05-13T00:00:00",
+     *     "balances": ["1000.0000 EOS", "1500.0000 USDT"]
+     * }
+     * ```
+     */
+    struct [[eosio::table("snapshots")]] snapshots_row {
+        time_point_sec          period;
+        vector<asset>           balances;
+
+        uint64_t primary_key() const { return period.sec_since_epoch(); }
+    };
+    typedef eosio::multi_index< "snapshots"_n, snapshots_row> snapshots_table;
+    typedef eosio::multi_index< "evm.snapshots"_n, snapshots_row> evm_snapshots_table;
+
+    /**
+     * ## TABLE `contracts`
+     *
+     * > Protocol contracts are stored once per version and referenced by `periods`
+     *
+     * - scope: `{name} protocol`
+     *
+     * ### params
+     *
+     * - `{uint64_t} version` - (primary key) contracts version
+     * - `{time_point_sec} period` - first period using this version
+     * - `{name} category` - protocol category
+     * - `{set<name>} contracts` - EOS contracts
+     * - `{set<checksum160>} evm_contracts` - EOS EVM contracts
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "version": 1,
+     *     "period": "2022-05-13T00:00:00",
+     *     "category": "dexes",
+     *     "contracts": ["myprotocol", "mytreasury"],
+     *     "evm_contracts": ["2f9ec37d6ccfff1cab21733bdadede11c823ccb0"]
+     * }
+     * ```
+     */
+    struct [[eosio::table("contracts")]] contracts_row {
+        uint64_t                version;
+        time_point_sec          period;
+        name                    category;
+        set<name>               contracts;
+        set<checksum160>        evm_contracts;
+
+        uint64_t primary_key() const { return version; }
+    };
+    typedef eosio::multi_index< "contracts"_n, contracts_row> contracts_table;
+
+    /**
+     * ## TABLE `periods.v2`
+     *
+     * > Replaces the `periods` table (legacy rows are moved by `migrate`)
+     *
+     * - scope: `{name} protocol`
+     * - primary key: `period` or ring buffer slot `period / PERIOD_INTERVAL % MAX_PERIODS_REPORT` (if `config.ring_buffer`)
+     *
+     * Balances referenced by `balances_at` are kept until no period of the last 24 hours references them (moved to key `period` once their ring buffer slot is overwritten).
+     *
+     * ### params
+     *
+     * - `{uint64_t} key` - (primary key) period at time or ring buffer slot
+     * - `{time_point_sec} period` - period at time
+     * - `{uint64_t} version` - protocol contracts version (see `contracts` table)
+     * - `{vector<asset>} balances` - asset balances (prices available in `prices` table)
+     * - `{asset} tvl` - reported TVL averaged value in EOS
+     * - `{asset} usd` - reported TVL averaged value in USD
+     * - `{time_point_sec} balances_at` - period of the last balances change (`balances` are omitted if before `period`, TVL revalued at current prices)
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "key": 1652400000,
+     *     "period": "2022-05-13T00:00:00",
+     *     "version": 1,
+     *     "balances": ["1000.0000 EOS", "1500.0000 USDT"],
+     *     "tvl": "200000.0000 EOS",
+     *     "usd": "300000.0000 USD",
+     *     "balances_at": "2022-05-13T00:00:00"
+     * }
+     * ```
+     */
+    struct [[eosio::table("periods.v2")]] periods_row {
+        uint64_t                key;
+        time_point_sec          period;
+        uint64_t                version;
+        vector<asset>           balances;
+        asset                   tvl;
+        asset                   usd;
+        time_point_sec          balances_at;
+
+        uint64_t primary_key() const { return key; }
+    };
+    typedef eosio::multi_index< "periods.v2"_n, periods_row> periods_table;
+
     /**
      * ## TABLE `periods`
      *
+     * > Legacy TVL periods (read-only, moved to `periods.v2` by `migrate`)
+     *
      * - scope: `{name} protocol`
      *
      * ### params
@@ -183,36 +482,237 @@ public:
      * - `{vector<asset>} prices` - currency prices
      * - `{asset} tvl` - reported TVL averaged value in EOS
      * - `{asset} usd` - reported TVL averaged value in USD
+     */
+    struct [[eosio::table("periods")]] legacy_periods_row {
+        time_point_sec          period;
+        name                    protocol;
+        name                    category;
+        set<name>               contracts;
+        set<string>             evm_contracts;
+        vector<asset>           balances;
+        vector<asset>           prices;
+        asset                   tvl;
+        asset                   usd;
+
+        uint64_t primary_key() const { return period.sec_since_epoch(); }
+    };
+    typedef eosio::multi_index< "periods"_n, legacy_periods_row> legacy_periods_table;
+
+    struct datapoint {
+        time_point_sec          period;
+        int64_t                 tvl;
+        int64_t                 usd;
+    };
+
+    /**
+     * ## TABLE `medians`
+     *
+     * > Incremental 8 hours buckets used to compute the TVL median of the last 24 hours
+     *
+     * Medians are only computed when the datapoints of each bucket cover at least 7 hours (a datapoint sampled every `tier_interval` covers `tier_interval`, otherwise a single period), buckets may mix sampling intervals after a protocol crosses `tier_tvl`.
+     *
+     * ### params
+     *
+     * - `{name} protocol` - (primary key) protocol contract
+     * - `{vector<datapoint>} bucket_1` - datapoints from 24 to 16 hours ago (sorted by TVL)
+     * - `{vector<datapoint>} bucket_2` - datapoints from 16 to 8 hours ago (sorted by TVL)
+     * - `{vector<datapoint>} bucket_3` - datapoints of the last 8 hours (sorted by TVL)
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "protocol": "myprotocol",
+     *     "bucket_1": [{"period": "2022-05-12T00:00:00", "tvl": 2000000000, "usd": 3000000000}],
+     *     "bucket_2": [{"period": "2022-05-12T08:00:00", "tvl": 2000000000, "usd": 3000000000}],
+     *     "bucket_3": [{"period": "2022-05-12T16:00:00", "tvl": 2000000000, "usd": 3000000000}]
+     * }
+     * ```
+     */
+    struct [[eosio::table("medians")]] medians_row {
+        name                    protocol;
+        vector<datapoint>       bucket_1;
+        vector<datapoint>       bucket_2;
+        vector<datapoint>       bucket_3;
+
+        uint64_t primary_key() const { return protocol.value; }
+    };
+    typedef eosio::multi_index< "medians"_n, medians_row> medians_table;
+
+    /**
+     * ## TABLE `reports`
+     *
+     * > Reports queued during `updateall`, sent to Yield+ in a single `reportbatch` per sampling interval by `flushreports`
+     *
+     * ### params
+     *
+     * - `{name} protocol` - (primary key) protocol contract
+     * - `{time_point_sec} period` - period time
+     * - `{uint32_t} period_interval` - sampling interval of the protocol (seconds)
+     * - `{asset} tvl` - TVL averaged value in EOS (empty if not enough datapoints, protocol is only rescheduled)
+     * - `{asset} usd` - TVL averaged value in USD
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "protocol": "myprotocol",
+     *     "period": "2022-05-13T00:00:00",
+     *     "period_interval": 600,
+     *     "tvl": "200000.0000 EOS",
+     *     "usd": "300000.0000 USD"
+     * }
+     * ```
+     */
+    struct [[eosio::table("reports")]] reports_row {
+        name                    protocol;
+        time_point_sec          period;
+        uint32_t                period_interval;
+        asset                   tvl;
+        asset                   usd;
+
+        uint64_t primary_key() const { return protocol.value; }
+    };
+    typedef eosio::multi_index< "reports"_n, reports_row> reports_table;
+
+    /**
+     * ## TABLE `scratch`
+     *
+     * > Partial balances of a chunked `update`, valuation & reporting run once all contracts of the period are read
+     *
+     * ### params
+     *
+     * - `{name} protocol` - (primary key) protocol contract
+     * - `{time_point_sec} period` - period of the partial update
+     * - `{set<name>} contracts` - EOS contracts being read (update restarts if modified)
+     * - `{set<checksum160>} evm_contracts` - EVM contracts being read (update restarts if modified)
+     * - `{uint16_t} cursor` - next contract to read (EOS contracts followed by EVM contracts)
+     * - `{vector<asset>} balances` - balances collected so far
+     * - `{vector<asset>} prices` - prices collected so far (logging purposes)
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "protocol": "myprotocol",
+     *     "period": "2022-05-13T00:00:00",
+     *     "contracts": ["myprotocol", "mytreasury", "myvault", "mypool", "mystaking"],
+     *     "evm_contracts": [],
+     *     "cursor": 4,
+     *     "balances": ["1.0000 EOS", "1.5000 USDT"],
+     *     "prices": ["1.5000 USD", "1.0000 USD"]
+     * }
+     * ```
+     */
+    struct [[eosio::table("scratch")]] scratch_row {
+        name                    protocol;
+        time_point_sec          period;
+        set<name>               contracts;
+        set<checksum160>        evm_contracts;
+        uint16_t                cursor;
+        vector<asset>           balances;
+        vector<asset>           prices;
+
+        uint64_t primary_key() const { return protocol.value; }
+    };
+    typedef eosio::multi_index< "scratch"_n, scratch_row> scratch_table;
+
+    /**
+     * ## TABLE `cursors`
+     *
+     * > Last active protocol scanned by each oracle's `updateall` (per oracle, allows oracles to scan in parallel)
+     *
+     * ### params
+     *
+     * - `{name} oracle` - (primary key) oracle account
+     * - `{name} protocol` - last active protocol scanned
+     * - `{time_point_sec} due_at` - due period of the last active protocol scanned
+     * - `{time_point_sec} period` - period of the last scan
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "oracle": "myoracle",
+     *     "protocol": "myprotocol",
+     *     "due_at": "1970-01-01T00:00:00",
+     *     "period": "2022-05-13T00:00:00"
+     * }
+     * ```
+     */
+    struct [[eosio::table("cursors")]] cursors_row {
+        name                    oracle;
+        name                    protocol;
+        time_point_sec          due_at;
+        time_point_sec          period;
+
+        uint64_t primary_key() const { return oracle.value; }
+    };
+    typedef eosio::multi_index< "cursors"_n, cursors_row> cursors_table;
+
+    /**
+     * ## TABLE `costs`
+     *
+     * > Observed CPU cost of a protocol `update`, used instead of the estimated cost when packing `updateall`
+     *
+     * Scoped by oracle (only used by the oracle's own `updateall`), bounded between half & double the estimated cost.
+     *
+     * ### params
+     *
+     * - `{name} protocol` - (primary key) protocol contract
+     * - `{uint32_t} cost` - observed CPU (us) of a single `update` (moving average)
+     * - `{time_point_sec} calibrated_at` - last calibration time
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *     "protocol": "myprotocol",
+     *     "cost": 850,
+     *     "calibrated_at": "2022-05-13T00:00:00"
+     * }
+     * ```
+     */
+    struct [[eosio::table("costs")]] costs_row {
+        name                    protocol;
+        uint32_t                cost;
+        time_point_sec          calibrated_at;
+
+        uint64_t primary_key() const { return protocol.value; }
+    };
+    typedef eosio::multi_index< "costs"_n, costs_row> costs_table;
+
+    /**
+     * ## TABLE `fingerprints`
+     *
+     * > Fingerprint of the last stored balances of each protocol (used if `config.skip_unchanged`)
+     *
+     * Erased when change detection is disabled (`setskip`) or the protocol is unregistered from Yield+ (`eraselog` notification).
+     *
+     * ### params
+     *
+     * - `{name} protocol` - (primary key) protocol contract
+     * - `{time_point_sec} balances_at` - period the balances were last stored
+     * - `{checksum256} fingerprint` - sha256 of contracts version & balances
      *
      * ### example
      *
      * ```json
      * {
-     *     "period": "2022-05-13T00:00:00",
      *     "protocol": "myprotocol",
-     *     "contracts": ["myprotocol", "mytreasury"],
-     *     "evm_contracts": ["0x2f9ec37d6ccfff1cab21733bdadede11c823ccb0"],
-     *     "balances": ["1000.0000 EOS", "1500.0000 USDT"],
-     *     "prices": ["1.5000 USD", "1.0000 USD"],
-     *     "tvl": "200000.0000 EOS",
-     *     "usd": "300000.0000 USD"
+     *     "balances_at": "2022-05-13T00:00:00",
+     *     "fingerprint": "6a0b2e4c1f0f4c3a9b6f8d7e5c4b3a291807f6e5d4c3b2a1908f7e6d5c4b3a29"
      * }
      * ```
      */
-    struct [[eosio::table("periods")]] periods_row {
-        time_point_sec          period;
+    struct [[eosio::table("fingerprints")]] fingerprints_row {
         name                    protocol;
-        name                    category;
-        set<name>               contracts;
-        set<string>             evm_contracts;
-        vector<asset>           balances;
-        vector<asset>           prices;
-        asset                   tvl;
-        asset                   usd;
+        time_point_sec          balances_at;
+        checksum256             fingerprint;
 
-        uint64_t primary_key() const { return period.sec_since_epoch(); }
+        uint64_t primary_key() const { return protocol.value; }
     };
-    typedef eosio::multi_index< "periods"_n, periods_row> periods_table;
+    typedef eosio::multi_index< "fingerprints"_n, fingerprints_row> fingerprints_table;
 
     /**
      * ## TABLE `oracles`
@@ -382,6 +882,181 @@ public:
     [[eosio::action]]
     void setreward( const asset reward_per_update );
 
+    /**
+     * ## ACTION `setstorage`
+     *
+     * > Set periods storage mode
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{bool} ring_buffer` - overwrite fixed ring buffer slots (`period / PERIOD_INTERVAL % MAX_PERIODS_REPORT`) instead of adding & pruning periods
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield setstorage '[true]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void setstorage( const bool ring_buffer );
+
+    /**
+     * ## ACTION `setmulticall`
+     *
+     * > Set EOS EVM multicall contract
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{bytes} multicall` - EOS EVM multicall contract (`tryAggregate`) used to batch `balanceOf` reads, empty to disable
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield setmulticall '["ca11bde05977b3631167028862be2a173976ca11"]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void setmulticall( const bytes multicall );
+
+    /**
+     * ## ACTION `setbudget`
+     *
+     * > Set estimated CPU budget of `updateall`
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{uint32_t} update_budget` - estimated CPU budget (us) of protocols packed by `updateall` (0 = disabled, only `max_rows` applies)
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield setbudget '[30000]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void setbudget( const uint32_t update_budget );
+
+    /**
+     * ## ACTION `settier`
+     *
+     * > Set sampling interval of low TVL protocols
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{asset} tier_tvl` - protocols with a reported TVL below this value are sampled every `tier_interval`
+     * - `{uint32_t} tier_interval` - sampling interval (seconds), multiple of 10 minutes dividing 8 hours & `report_interval` (0 = disabled)
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield settier '["1000000.0000 EOS", 3600]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void settier( const asset tier_tvl, const uint32_t tier_interval );
+
+    /**
+     * ## ACTION `setreport`
+     *
+     * > Set interval of reports sent to Yield+
+     *
+     * Protocols are still sampled every period (or `tier_interval`), medians are only computed & reported to Yield+ at the first sample once `report_interval` elapsed since the last report (`period_at`), a missed sample delays the report to the next sample.
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{uint32_t} report_interval` - report interval (seconds), multiple of 10 minutes & `tier_interval` dividing 8 hours (0 = reported at each sample)
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield setreport '[3600]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void setreport( const uint32_t report_interval );
+
+    /**
+     * ## ACTION `setskip`
+     *
+     * > Set change detection of protocol balances
+     *
+     * Balances identical to the previous period (compared by fingerprint) are stored as a compact `periods` row (empty `balances`, previous `balances_at`) and logged with `unchangedlog` instead of `updatelog`.
+     * Full balances are stored again once the referenced `periods` row is pruned or overwritten (24 hours). Fingerprints are erased when change detection is disabled.
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{bool} skip_unchanged` - skip storing & logging unchanged balances
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield setskip '[true]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void setskip( const bool skip_unchanged );
+
+    /**
+     * ## ACTION `calibrate`
+     *
+     * > Record the observed CPU cost of a protocol `update`
+     *
+     * Costs are recorded in the oracle's own scope and only used to pack its `updateall`, the cost used is bounded between half & double the estimated cost.
+     *
+     * - **authority**: `oracle`
+     *
+     * ### params
+     *
+     * - `{name} oracle` - oracle account (must be approved)
+     * - `{name} protocol` - protocol account
+     * - `{uint32_t} cost` - observed CPU (us) of a single `update` of the protocol
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield calibrate '[myoracle, myprotocol, 850]' -p myoracle
+     * ```
+     */
+    [[eosio::action]]
+    void calibrate( const name oracle, const name protocol, const uint32_t cost );
+
+    /**
+     * ## ACTION `migrate`
+     *
+     * > Move legacy `periods` rows of {{protocol}} to `periods.v2`
+     *
+     * Periods of the last 24 hours are converted (contracts stored as a `contracts` version, prices dropped) and added to the median buckets, older periods are erased.
+     * Should be executed for each protocol before `updateall` resumes, remaining rows are moved by calling the action again.
+     * Rejected if `periods.v2` or `contracts` already store periods newer than the legacy periods of the last 24 hours.
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{name} protocol` - protocol contract
+     * - `{uint16_t} [max_rows=50]` - (optional) maximum legacy rows moved
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield migrate '[myprotocol, null]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void migrate( const name protocol, const optional<uint16_t> max_rows );
+
     /**
      * ## ACTION `regoracle`
      *
@@ -511,6 +1186,9 @@ public:
      *
      * > Update TVL for a specific protocol
      *
+     * Protocols with more than `UPDATE_CHUNK_SIZE` contracts are read in chunks, partial balances are kept in `scratch` until all contracts of the period are read.
+     * Token balances are only read for supported tokens held by each contract (`holdings` table), a supported token newly received by a contract that already holds other supported tokens can be missed for up to 1 hour.
+     *
      * - **authority**: `oracle`
      *
      * ### params
@@ -532,6 +1210,12 @@ public:
      *
      * > Update the TVL for all protocols
      *
+     * Resumes after the last scanned protocol of the current period (`cursors` row of the oracle), protocols activated behind the cursor are updated starting next period.
+     *
+     * Protocols are sharded across active oracles, each protocol is assigned to a single oracle slot (hash of the protocol name modulo the number of active oracles, slots ordered by oracle name). Protocols that missed the previous period and are overdue by `FAILOVER_GRACE` (30 minutes after the due period or last report `period_at`) are open to every active oracle (failover), the grace window of protocols never scheduled (new or re-activated) starts at their activation period.
+     *
+     * A protocol updated in chunks (see `update`) ends the scan, the next `updateall` resumes with its next chunk.
+     *
      * - **authority**: `oracle`
      *
      * ### params
@@ -548,6 +1232,49 @@ public:
     [[eosio::action]]
     void updateall( const name oracle, const optional<uint16_t> max_rows );
 
+    /**
+     * ## ACTION `flushreports`
+     *
+     * > Send reports queued by `updateall` to Yield+ in a single `reportbatch`
+     *
+     * Protocols queued without TVL (not enough datapoints) are sent to Yield+ `schedule` to move them to the next report period.
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield flushreports '[]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void flushreports();
+
+    /**
+     * ## ACTION `updatebatch`
+     *
+     * > Update the TVL of protocols selected by `updateall`
+     *
+     * Protocols that cannot be updated (already updated, not active, invalid oracle prices, mismatched balance symbols or unknown EVM accounts) are skipped instead of aborting the batch, skipped protocols are logged with `skiplog`.
+     *
+     * Shared state (config, period & EVM tokens) is loaded once per batch and oracle rewards are allocated with a single `rewardslog`. Balances of contracts listed by several protocols are read once per period (`snapshots` table), every batch & oracle of the period values them from identical balances.
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{name} oracle` - oracle account (must be approved)
+     * - `{vector<name>} protocols` - protocols to update
+     *
+     * ### Example
+     *
+     * ```bash
+     * $ cleos push action oracle.yield updatebatch '[myoracle, [myprotocol]]' -p oracle.yield
+     * ```
+     */
+    [[eosio::action]]
+    void updatebatch( const name oracle, const vector<name> protocols );
+
     /**
      * ## ACTION `updatelog`
      *
@@ -561,7 +1288,7 @@ public:
      * - `{name} protocol` - protocol updated
      * - `{name} category` - protocol category
      * - `{set<name>} contracts` - EOS contracts
-     * - `{set<string>} evm` - EVM contracts
+     * - `{set<checksum160>} evm` - EVM contracts
      * - `{time_point_sec} period` - time period
      * - `{vector<asset>} balances` - balances in all contracts
      * - `{vector<asset>} prices` - prices of assets
@@ -586,7 +1313,39 @@ public:
      * ```
      */
     [[eosio::action]]
-    void updatelog( const name oracle, const name protocol, const name category, const set<name> contracts, const set<string> evm, const time_point_sec period, const vector<asset> balances, const vector<asset> prices, const asset tvl, const asset usd );
+    void updatelog( const name oracle, const name protocol, const name category, const set<name> contracts, const set<checksum160> evm, const time_point_sec period, const vector<asset> balances, const vector<asset> prices, const asset tvl, const asset usd );
+
+    /**
+     * ## ACTION `unchangedlog`
+     *
+     * > Generates a log when an oracle updates a protocol with balances unchanged since `balances_at` (see `updatelog` of that period)
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{name} oracle` - oracle initiated update
+     * - `{name} protocol` - protocol updated
+     * - `{time_point_sec} period` - time period
+     * - `{time_point_sec} balances_at` - period of the last balances change
+     * - `{asset} tvl` - overall TVL revalued at current prices
+     * - `{asset} usd` - overall TVL in USD revalued at current prices
+     *
+     * ### Example
+     *
+     * ```json
+     * {
+     *     "oracle": "myoracle",
+     *     "protocol": "myprotocol",
+     *     "period": "2022-06-16T01:40:00",
+     *     "balances_at": "2022-06-16T01:00:00",
+     *     "tvl": "200000.0000 EOS",
+     *     "usd": "300000.0000 USD"
+     * }
+     * ```
+     */
+    [[eosio::action]]
+    void unchangedlog( const name oracle, const name protocol, const time_point_sec period, const time_point_sec balances_at, const asset tvl, const asset usd );
 
     /**
      * ## ACTION `claim`
@@ -750,12 +1509,14 @@ public:
      *
      * > Generates a log when rewards are generated from update.
      *
+     * A single aggregated entry is emitted per `updatebatch` (rewards of every protocol updated in the batch), `update` emits one entry per protocol.
+     *
      * - **authority**: `get_self()`
      *
      * ### params
      *
      * - `{name} oracle` - oracle
-     * - `{asset} rewards` - Oracle push reward
+     * - `{asset} rewards` - Oracle push reward (`reward_per_update` multiplied by the number of protocols updated)
      * - `{asset} balance` - current claimable balance
      *
      * ### Example
@@ -771,6 +1532,58 @@ public:
     [[eosio::action]]
     void rewardslog( const name oracle, const asset rewards, const asset balance );
 
+    /**
+     * ## ACTION `skiplog`
+     *
+     * > Generates a log when protocols are skipped by `updatebatch`
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{name} oracle` - oracle initiated update
+     * - `{time_point_sec} period` - time period
+     * - `{uint16_t} updated` - number of protocols updated
+     * - `{map<name, name>} skipped` - skipped protocols & reasons (`notexists/notactive/updated/price/symbol/evmaccount`)
+     *
+     * ### Example
+     *
+     * ```json
+     * {
+     *     "oracle": "myoracle",
+     *     "period": "2022-06-16T01:40:00",
+     *     "updated": 19,
+     *     "skipped": [{"key": "myprotocol", "value": "updated"}]
+     * }
+     * ```
+     */
+    [[eosio::action]]
+    void skiplog( const name oracle, const time_point_sec period, const uint16_t updated, const map<name, name> skipped );
+
+    /**
+     * ## ACTION `evmerrorlog`
+     *
+     * > Generates a log when an EOS EVM `balancesof` multicall fails (previous balances are kept)
+     *
+     * - **authority**: `get_self()`
+     *
+     * ### params
+     *
+     * - `{int32_t} status` - EOS EVM execution status
+     * - `{bytes} context` - token contract & address (20 bytes each) of each `balanceOf` call
+     *
+     * ### Example
+     *
+     * ```json
+     * {
+     *     "status": 1,
+     *     "context": "ca11bde05977b3631167028862be2a173976ca112f9ec37d6ccfff1cab21733bdadede11c823ccb0"
+     * }
+     * ```
+     */
+    [[eosio::action]]
+    void evmerrorlog( const int32_t status, const bytes context );
+
     [[eosio::action]]
     void callback( const int32_t status, bytes data, const std::optional<bytes> context );
 
@@ -778,6 +1591,13 @@ public:
     void balanceof( const bytes contract, const bytes address );
     using balanceof_action = eosio::action_wrapper<"balanceof"_n, &oracle::balanceof>;
 
+    [[eosio::action]]
+    void callbackall( const int32_t status, bytes data, const std::optional<bytes> context );
+
+    [[eosio::action]]
+    void balancesof( const vector<bytes> addresses );
+    using balancesof_action = eosio::action_wrapper<"balancesof"_n, &oracle::balancesof>;
+
     [[eosio::action]]
     void setbalance( const bytes contract, const bytes address, const asset balance );
     using setbalance_action = eosio::action_wrapper<"setbalance"_n, &oracle::setbalance>;
@@ -785,6 +1605,9 @@ public:
     [[eosio::on_notify("*::transfer")]]
     void on_transfer( const name from, const name to, const asset quantity, const std::string memo );
 
+    [[eosio::on_notify("*::eraselog")]]
+    void on_eraselog( const name protocol );
+
     // DEBUG (used to help testing)
     #ifdef DEBUG
     [[eosio::action]]
@@ -798,6 +1621,8 @@ public:
     // action wrappers
     using update_action = eosio::action_wrapper<"update"_n, &oracle::update>;
     using updateall_action = eosio::action_wrapper<"updateall"_n, &oracle::updateall>;
+    using flushreports_action = eosio::action_wrapper<"flushreports"_n, &oracle::flushreports>;
+    using updatebatch_action = eosio::action_wrapper<"updatebatch"_n, &oracle::updatebatch>;
     using regoracle_action = eosio::action_wrapper<"regoracle"_n, &oracle::regoracle>;
     using unregister_action = eosio::action_wrapper<"unregister"_n, &oracle::unregister>;
     using approve_action = eosio::action_wrapper<"approve"_n, &oracle::approve>;
@@ -805,41 +1630,91 @@ public:
     using addtoken_action = eosio::action_wrapper<"addtoken"_n, &oracle::addtoken>;
     using deltoken_action = eosio::action_wrapper<"deltoken"_n, &oracle::deltoken>;
     using setreward_action = eosio::action_wrapper<"setreward"_n, &oracle::setreward>;
+    using setstorage_action = eosio::action_wrapper<"setstorage"_n, &oracle::setstorage>;
+    using setmulticall_action = eosio::action_wrapper<"setmulticall"_n, &oracle::setmulticall>;
+    using setbudget_action = eosio::action_wrapper<"setbudget"_n, &oracle::setbudget>;
+    using settier_action = eosio::action_wrapper<"settier"_n, &oracle::settier>;
+    using setreport_action = eosio::action_wrapper<"setreport"_n, &oracle::setreport>;
+    using setskip_action = eosio::action_wrapper<"setskip"_n, &oracle::setskip>;
+    using calibrate_action = eosio::action_wrapper<"calibrate"_n, &oracle::calibrate>;
+    using migrate_action = eosio::action_wrapper<"migrate"_n, &oracle::migrate>;
     using claim_action = eosio::action_wrapper<"claim"_n, &oracle::claim>;
 
     using updatelog_action = eosio::action_wrapper<"updatelog"_n, &oracle::updatelog>;
+    using unchangedlog_action = eosio::action_wrapper<"unchangedlog"_n, &oracle::unchangedlog>;
     using claimlog_action = eosio::action_wrapper<"claimlog"_n, &oracle::claimlog>;
     using rewardslog_action = eosio::action_wrapper<"rewardslog"_n, &oracle::rewardslog>;
+    using skiplog_action = eosio::action_wrapper<"skiplog"_n, &oracle::skiplog>;
+    using evmerrorlog_action = eosio::action_wrapper<"evmerrorlog"_n, &oracle::evmerrorlog>;
     using statuslog_action = eosio::action_wrapper<"statuslog"_n, &oracle::statuslog>;
     using createlog_action = eosio::action_wrapper<"createlog"_n, &oracle::createlog>;
     using eraselog_action = eosio::action_wrapper<"eraselog"_n, &oracle::eraselog>;
     using metadatalog_action = eosio::action_wrapper<"metadatalog"_n, &oracle::metadatalog>;
 
 private:
+    // shared state loaded once per `update` or `updatebatch`
+    struct update_context {
+        name                    oracle;
+        config_row              config;
+        time_point_sec          period;
+        bool                    batch_reports = false;
+        vector<evm_tokens_row>  evm_tokens;
+
+        // balances of contracts already valued within the action (`snapshots` tables are shared across actions of the period)
+        map<name, vector<asset>>            balances;
+        map<checksum160, vector<asset>>     evm_balances;
+    };
+
     // utils
     time_point_sec get_current_period( const uint32_t period_interval );
     time_point_sec get_last_period( const uint32_t last );
+    uint64_t get_period_key( const time_point_sec period, const bool ring_buffer );
     oracle::config_row get_config();
     void set_status( const name oracle, const name status );
     void check_oracle_active( const name oracle );
-    void generate_report( const name protocol, const time_point_sec period );
-    void allocate_oracle_rewards( const name oracle );
+    void generate_report( const update_context& context, const name protocol, const uint32_t report_interval );
+    uint32_t get_sampling_interval( const config_row& config, const asset tvl );
+    update_context get_update_context( const name oracle );
+    name update_protocol( update_context& context, const name protocol, const bool soft );
+    void allocate_oracle_rewards( const config_row& config, const name oracle, const uint16_t updates );
     void transfer( const name from, const name to, const extended_asset value, const string& memo );
-    void prune_protocol_periods( const name protocol );
+    void prune_protocol_periods( const name protocol, const bool ring_buffer );
+    uint64_t set_contracts_version( const name protocol, const name category, const set<name> contracts, const set<checksum160> evm_contracts, const time_point_sec period );
     void notify_admin();
     void require_auth_admin();
     void require_auth_admin( const name account );
     bool is_contract( const name contract );
+    void set_tokens_modified();
+    uint64_t get_oracle_slot( const name oracle, uint64_t& slots );
+    uint64_t get_protocol_slot( const name protocol, const uint64_t slots );
+    uint32_t estimate_update_cost( const name oracle, const name protocol, const uint16_t contracts, const uint16_t evm_contracts, const uint32_t tokens, const uint32_t evm_tokens );
+    bool is_period_missed( const name protocol, const time_point_sec period, const uint32_t interval, const time_point_sec due_at, const time_point_sec period_at, const bool ring_buffer );
+    uint16_t get_update_cursor( const name protocol, const time_point_sec period, const set<name>& contracts, const set<checksum160>& evm_contracts );
+    time_point_sec get_referenced_balances_at( const name protocol, const bool ring_buffer );
+    time_point_sec set_balances_fingerprint( const name protocol, const time_point_sec period, const uint64_t version, const vector<asset>& balances, const bool ring_buffer );
 
     // getters
-    asset get_balance_quantity( const name token_contract_account, const name owner, const symbol sym );
+    optional<asset> find_balance_quantity( const name token_contract_account, const name owner, const symbol sym );
     asset get_eos_staked( const name owner );
-    periods_row get_median( const name protocol, const uint64_t period_start, const uint64_t period_end );
+    name add_contract_balances( update_context& context, const name contract, const bool soft, vector<asset>& balances );
+    name add_evm_contract_balances( update_context& context, const checksum160& address, const bool soft, vector<asset>& balances );
+    vector<extended_symbol> get_holdings( const name contract );
+    datapoint get_median( const vector<datapoint>& bucket, const uint32_t tier_interval );
+    uint32_t get_bucket_coverage( const vector<datapoint>& bucket, const uint32_t tier_interval );
+
+    // medians
+    void add_median_datapoint( const name protocol, const datapoint value );
+    void shift_median_buckets( medians_row& medians, const uint64_t current_time_sec );
+    void move_datapoints( vector<datapoint>& from, vector<datapoint>* to, const uint64_t boundary );
+    void insert_datapoint( vector<datapoint>& bucket, const datapoint value );
 
     // calculate prices
     int64_t calculate_usd_value( const asset quantity );
     int64_t convert_usd_to_eos( const int64_t usd );
     int64_t get_oracle_price( const symbol sym );
+    int64_t set_oracle_price( const symbol sym, string& error );
+    int64_t find_oracle_price( const symbol sym, string& error );
+    bool is_price_valid( const symbol sym );
     int64_t normalize_price( const int64_t price, const uint8_t precision );
     int64_t get_delphi_price( const name delphi_oracle_id );
     int64_t get_defibox_price( const uint64_t defibox_oracle_id );
@@ -847,7 +1722,17 @@ private:
 
     // EVM
     int64_t bytes_to_int64( const bytes data, const uint8_t decimals );
-    asset get_evm_balance_quantity(const uint64_t token_id, const string evm_contract, const symbol sym );
+    optional<asset> find_evm_balance_quantity( const uint64_t token_id, const uint64_t address_id, const symbol sym );
+    void set_evm_balance( const uint64_t token_id, const bytes address, const asset balance );
+    uint64_t get_evm_account_id( const bytes& address );
+    optional<uint64_t> find_evm_account_id( const bytes& address );
+    void append_abi_word( bytes& data, const uint64_t value );
+    void append_abi_address( bytes& data, const bytes& address );
+    uint64_t read_abi_word( const bytes& data, const uint64_t position );
+    bytes add_evm_request( const bytes& context );
+    bytes consume_evm_request( const bytes& request );
+    template <typename T>
+    void set_balances_snapshot( T& snapshots, const time_point_sec period, const vector<asset>& balances );
 
     // DEBUG (used to help testing)
     #ifdef DEBUG
@@ -1,14 +1,79 @@
-import { Name, Asset } from "@greymass/eosio";
+import { Name, Asset, TimePointSec } from "@greymass/eosio";
 import { expectToThrow } from "@tests/helpers";
 import { blockchain, contracts } from "@tests/init";
 import { metadata_oracle, RATE, MIN_TVL, MAX_TVL, PERIOD_INTERVAL } from "@tests/constants";
-import { OracleConfig, Oracle, Period, Protocol } from '@tests/interfaces';
+import { OracleConfig, OracleState, Oracle, Contracts, Holdings, Median, Period, LegacyPeriod, Price, Protocol, Active, Scratch, Cursor, Cost, Fingerprint, Request, EvmBalance, Snapshot } from '@tests/interfaces';
 
 const getConfig = (): OracleConfig => {
   const scope = Name.from('oracle.yield').value.value;
   return contracts.yield.oracle.tables.config(scope).getTableRows()[0];
 }
 
+const getState = (): OracleState => {
+  const scope = Name.from('oracle.yield').value.value;
+  return contracts.yield.oracle.tables.state(scope).getTableRows()[0];
+}
+
+const getCursor = ( oracle: string ): Cursor => {
+  const scope = Name.from('oracle.yield').value.value;
+  const primary_key = Name.from(oracle).value.value;
+  return contracts.yield.oracle.tables.cursors(scope).getTableRow(primary_key);
+}
+
+const getCost = ( protocol: string, oracle = "myoracle" ): Cost => {
+  const scope = Name.from(oracle).value.value;
+  const primary_key = Name.from(protocol).value.value;
+  return contracts.yield.oracle.tables.costs(scope).getTableRow(primary_key);
+}
+
+const getFingerprint = ( protocol: string ): Fingerprint => {
+  const scope = Name.from('oracle.yield').value.value;
+  const primary_key = Name.from(protocol).value.value;
+  return contracts.yield.oracle.tables.fingerprints(scope).getTableRow(primary_key);
+}
+
+const getRequests = (): Request[] => {
+  const scope = Name.from('oracle.yield').value.value;
+  return contracts.yield.oracle.tables.requests(scope).getTableRows();
+}
+
+const getSnapshots = ( contract: string ): Snapshot[] => {
+  const scope = Name.from(contract).value.value;
+  return contracts.yield.oracle.tables.snapshots(scope).getTableRows();
+}
+
+const getEvmBalance = ( token_id: number, address_id: number ): EvmBalance => {
+  return contracts.yield.oracle.tables["evm.balances"](BigInt(token_id)).getTableRow(BigInt(address_id));
+}
+
+// cache `eosio.evm` account IDs & add supported EOS EVM token (same key as `oracle::find_evm_account_id`)
+const setEvmToken = ( token: string, token_id: number, decimals: number, sym: string, addresses: {[address: string]: number} ) => {
+  const scope = Name.from('oracle.yield').value.value;
+  for ( const [address, account_id] of Object.entries({ [token]: token_id, ...addresses }) ) {
+    contracts.yield.oracle.tables["evm.accounts"](scope).set(BigInt("0x" + address.slice(0, 16)), Name.from("oracle.yield"), {
+      key: BigInt("0x" + address.slice(0, 16)).toString(),
+      address,
+      account_id,
+    });
+  }
+  contracts.yield.oracle.tables["evm.tokens"](scope).set(BigInt(token_id), Name.from("oracle.yield"), {
+    token_id,
+    address: token,
+    decimals,
+    sym,
+  });
+}
+
+const setMulticall = ( multicall: string ) => {
+  const scope = Name.from('oracle.yield').value.value;
+  contracts.yield.oracle.tables.config(scope).set(Name.from("config").value.value, Name.from("oracle.yield"), { ...getConfig(), multicall });
+}
+
+// ABI encoded uint256 word
+const toWord = ( value: bigint ): string => {
+  return value.toString(16).padStart(64, "0");
+}
+
 const getOracle = ( oracle: string ): Oracle => {
   const scope = Name.from('oracle.yield').value.value;
   const primary_key = Name.from(oracle).value.value;
@@ -17,14 +82,65 @@ const getOracle = ( oracle: string ): Oracle => {
 
 const getPeriods = ( protocol: string ): Period[] => {
   const scope = Name.from(protocol).value.value;
-  const rows = contracts.yield.oracle.tables.periods(scope).getTableRows();
+  const rows = contracts.yield.oracle.tables["periods.v2"](scope).getTableRows();
   return rows;
 }
 
+// seed a period of myprotocol (`balances_at` before `period` is stored as an unchanged marker)
+const setPeriod = ( key: number, period: number, balances_at: number, from: Period ) => {
+  const scope = Name.from("myprotocol").value.value;
+  contracts.yield.oracle.tables["periods.v2"](scope).set(BigInt(key), Name.from("oracle.yield"), {
+    ...from,
+    key,
+    period: TimePointSec.from(period).toString(),
+    balances: period == balances_at ? from.balances : [],
+    balances_at: TimePointSec.from(balances_at).toString(),
+  });
+}
+
+const getLegacyPeriods = ( protocol: string ): LegacyPeriod[] => {
+  const scope = Name.from(protocol).value.value;
+  return contracts.yield.oracle.tables.periods(scope).getTableRows();
+}
+
+const getContracts = ( protocol: string ): Contracts[] => {
+  const scope = Name.from(protocol).value.value;
+  return contracts.yield.oracle.tables.contracts(scope).getTableRows();
+}
+
+const getHoldings = ( contract: string ): Holdings => {
+  const scope = Name.from('oracle.yield').value.value;
+  const primary_key = Name.from(contract).value.value;
+  return contracts.yield.oracle.tables.holdings(scope).getTableRow(primary_key);
+}
+
+const getScratch = ( protocol: string ): Scratch => {
+  const scope = Name.from('oracle.yield').value.value;
+  const primary_key = Name.from(protocol).value.value;
+  return contracts.yield.oracle.tables.scratch(scope).getTableRow(primary_key);
+}
+
+const getPrices = ( symcode: string ): Price[] => {
+  const scope = Asset.SymbolCode.from(symcode).value.value;
+  return contracts.yield.oracle.tables.prices(scope).getTableRows();
+}
+
+const getMedians = ( protocol: string ): Median => {
+  const scope = Name.from('oracle.yield').value.value;
+  const primary_key = Name.from(protocol).value.value;
+  return contracts.yield.oracle.tables.medians(scope).getTableRow(primary_key);
+}
+
 const getProtocol = ( protocol: string ): Protocol => {
   const scope = Name.from('eosio.yield').value.value;
   const primary_key = Name.from(protocol).value.value;
-  return contracts.yield.eosio.tables.protocols(scope).getTableRow(primary_key)
+  return contracts.yield.eosio.tables["protocols.v2"](scope).getTableRow(primary_key)
+}
+
+const getActive = ( protocol: string ): Active => {
+  const scope = Name.from('eosio.yield').value.value;
+  const primary_key = Name.from(protocol).value.value;
+  return contracts.yield.eosio.tables.active(scope).getTableRow(primary_key)
 }
 
 const getBalance = ( account: string, symcode = "EOS" ): number => {
@@ -36,6 +152,43 @@ const getBalance = ( account: string, symcode = "EOS" ): number => {
   return 0;
 }
 
+// same mix as `oracle::get_protocol_slot`
+const getProtocolSlot = ( protocol: string, slots: number ): number => {
+  const mask = (1n << 64n) - 1n;
+  let hash = BigInt(Name.from(protocol).value.toString());
+  hash = ((hash ^ (hash >> 33n)) * 0xff51afd7ed558ccdn) & mask;
+  hash = ((hash ^ (hash >> 33n)) * 0xc4ceb9fe1a85ec53n) & mask;
+  hash = hash ^ (hash >> 33n);
+  return Number(hash % BigInt(slots));
+}
+
+// rewards of a Yield+ report (same rounding as `yield::add_report`)
+const calculateIntervalRewards = ( tvl: string, period_interval: number ) => {
+  return Number(BigInt(Asset.from(tvl).units.toNumber()) * BigInt(RATE) * BigInt(period_interval) / 10000n / 31536000n);
+}
+
+// next hour boundary after the last report of myprotocol
+const getNextHour = ( hours = 1 ): number => {
+  const period_at = TimePointSec.from(getProtocol("myprotocol").period_at).toMilliseconds() / 1000;
+  return ( Math.floor(period_at / 3600) + hours ) * 3600;
+}
+
+// datapoints sampled every `step` seconds after `start`
+const getDatapoints = ( start: number, count: number, step: number ) => Array.from({ length: count }, (_, i) => {
+  return { period: TimePointSec.from(start + (i + 1) * step).toString(), tvl: 3000000000, usd: 4160700000 };
+});
+
+// seed datapoints sampled every `step` seconds in each 8 hours bucket (relative to `now`)
+const setMedians = ( protocol: string, now: number, counts: number[], step = 3600, bucket_3?: ReturnType<typeof getDatapoints> ) => {
+  const scope = Name.from('oracle.yield').value.value;
+  contracts.yield.oracle.tables.medians(scope).set(Name.from(protocol).value.value, Name.from("oracle.yield"), {
+    protocol,
+    bucket_1: getDatapoints(now - 86400, counts[0], step),
+    bucket_2: getDatapoints(now - 57600, counts[1], step),
+    bucket_3: bucket_3 ?? getDatapoints(now - 28800, counts[2], step),
+  });
+}
+
 const calculateRewards = (tvl: string) => {
   return Number(BigInt(Asset.from(tvl).units.toNumber()) * BigInt(RATE) / 365n / 24n / 6n / 10000n);
 }
@@ -114,6 +267,92 @@ describe('oracle.yield', () => {
     expect(Asset.from(after.balance.quantity).value).toEqual(0.02);
   });
 
+  it("update::prices snapshot", async () => {
+    const prices = getPrices("EOS");
+    expect(prices.length).toEqual(1);
+    expect(prices[0].sym).toEqual("4,EOS");
+    expect(prices[0].price).toEqual("1.3869 USD");
+  });
+
+  it("update::holdings", async () => {
+    const holdings = getHoldings("myprotocol");
+    expect(holdings.tokens).toEqual([{sym: "4,USDT", contract: "tethertether"}]);
+  });
+
+  it("update::scratch", async () => {
+    // protocol contracts fit in a single chunk, no partial balances are kept
+    expect(getScratch("myprotocol")).toBeUndefined();
+  });
+
+  it("update::chunked protocol", async () => {
+    // more than `UPDATE_CHUNK_SIZE` (4) contracts
+    const chunked = ["protocol1", "protocol2", "protocol3", "myvault", "vault"];
+    const auth = chunked.map(contract => { return { actor: contract, permission: "active"} });
+    await contracts.yield.eosio.actions.regprotocol(["protocol1", "dexes", metadata_oracle]).send('protocol1@active');
+    await contracts.yield.eosio.actions.setcontracts(["protocol1", chunked, []]).send(auth);
+    await contracts.yield.eosio.actions.approve(["protocol1"]).send("admin.yield@active");
+    const balance = getOracle("myoracle").balance.quantity;
+
+    // first chunk is partial (balances kept in scratch, no period & no oracle reward)
+    await contracts.yield.oracle.actions.update(["myoracle", "protocol1"]).send();
+    expect(getScratch("protocol1").cursor).toEqual(4);
+    expect(getPeriods("protocol1").length).toEqual(0);
+    expect(getOracle("myoracle").balance.quantity).toEqual(balance);
+
+    // last chunk writes the period once
+    await contracts.yield.oracle.actions.update(["myoracle", "protocol1"]).send();
+    expect(getScratch("protocol1")).toBeUndefined();
+    expect(getPeriods("protocol1").length).toEqual(1);
+    expect(getOracle("myoracle").balance.quantity).not.toEqual(balance);
+
+    const action = contracts.yield.oracle.actions.update(["myoracle", "protocol1"]).send();
+    await expectToThrow(action, "eosio_assert: oracle::update: [period] for [protocol] is already updated");
+
+    // keep `updateall` specs on a single protocol
+    await contracts.yield.eosio.actions.unregister(["protocol1"]).send('protocol1@active');
+  });
+
+  it("updatebatch::shared contract balances", async () => {
+    // two protocols listing the same contract
+    await contracts.token.USDT.actions.transfer(["tethertether", "vault", "1000.0000 USDT", "init"]).send("tethertether@active");
+    for ( const protocol of ["protocol1", "protocol2"] ) {
+      await contracts.yield.eosio.actions.regprotocol([protocol, "dexes", metadata_oracle]).send(`${protocol}@active`);
+      await contracts.yield.eosio.actions.setcontracts([protocol, ["vault"], []]).send(`${protocol}@active`);
+      await contracts.yield.eosio.actions.approve([protocol]).send("admin.yield@active");
+    }
+
+    // contract balances are read once and shared within the batch
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updatebatch(["myoracle", ["protocol1", "protocol2"]]).send();
+    const period1 = getPeriods("protocol1").slice(-1)[0];
+    const period2 = getPeriods("protocol2").slice(-1)[0];
+    expect(period1.period).toEqual(period2.period);
+    expect(period1.balances).toEqual(["1000.0000 USDT"]);
+    expect(period2.balances).toEqual(period1.balances);
+    expect(period2.tvl).toEqual(period1.tvl);
+    expect(getSnapshots("vault").map(row => row.period)).toEqual([period1.period]);
+
+    // snapshot is shared by later batches of the same period, previous periods are erased
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updatebatch(["myoracle", ["protocol1"]]).send();
+    await contracts.token.USDT.actions.transfer(["tethertether", "vault", "1000.0000 USDT", "init"]).send("tethertether@active");
+    await contracts.yield.oracle.actions.updatebatch(["myoracle", ["protocol2"]]).send();
+    expect(getPeriods("protocol2").slice(-1)[0].balances).toEqual(["1000.0000 USDT"]);
+    expect(getSnapshots("vault").map(row => row.period)).toEqual([getPeriods("protocol1").slice(-1)[0].period]);
+
+    // keep `updateall` specs on a single protocol
+    for ( const protocol of ["protocol1", "protocol2"] ) {
+      await contracts.yield.eosio.actions.unregister([protocol]).send(`${protocol}@active`);
+    }
+  });
+
+  it("update::reschedule without report", async () => {
+    // not enough datapoints for a report, protocol is moved to the next period
+    const period = TimePointSec.from(getPeriods("myprotocol")[0].period).toMilliseconds();
+    const due_at = TimePointSec.from(getActive("myprotocol").due_at).toMilliseconds();
+    expect(due_at).toEqual(period + PERIOD_INTERVAL.toMilliseconds());
+  });
+
   it("oracle.yield::claim", async () => {
     const balance = Asset.from(getOracle("myoracle").balance.quantity).value;
     expect(getBalance("myoracle", "EOS")).toBe(0);
@@ -130,6 +369,18 @@ describe('oracle.yield', () => {
     expect(Asset.from(oracle.balance.quantity).value).toEqual(0.02);
   });
 
+  it("updateall::cursor", async () => {
+    expect(getCursor("myoracle").protocol).toEqual("myprotocol");
+    const action = contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    await expectToThrow(action, "eosio_assert: oracle::updateall: nothing to update");
+  });
+
+  it("updatebatch::skip already updated", async () => {
+    const periods = getPeriods("myprotocol").length;
+    await contracts.yield.oracle.actions.updatebatch(["myoracle", ["myprotocol"]]).send();
+    expect(getPeriods("myprotocol").length).toEqual(periods);
+  });
+
   it("updateall::145 times", async () => {
     let count = 145;
     while (count > 0 ) {
@@ -138,6 +389,18 @@ describe('oracle.yield', () => {
       count -= 1;
     }
     expect(getPeriods("myprotocol").length).toEqual(144);
+
+    // contracts are stored once and referenced by version
+    const versions = getContracts("myprotocol");
+    expect(versions.length).toEqual(1);
+    expect(versions[0].contracts).toEqual(["myprotocol"]);
+    expect(getPeriods("myprotocol")[0].version).toEqual(versions[0].version);
+
+    // each 8 hours bucket contains 48 periods
+    const medians = getMedians("myprotocol");
+    expect(medians.bucket_1.length).toEqual(48);
+    expect(medians.bucket_2.length).toEqual(48);
+    expect(medians.bucket_3.length).toEqual(48);
   });
 
   it("updateall::check protocol balance", async () => {
@@ -150,6 +413,382 @@ describe('oracle.yield', () => {
     expect(Asset.from(after.balance.quantity).value * 10000).toEqual(balance.value * 10000 + rewards);
   });
 
+  it("updateall::protocol slot", async () => {
+    // second active oracle (slots ordered by oracle name)
+    await contracts.yield.oracle.actions.regoracle(["foobar", metadata_oracle]).send('foobar@active');
+    await contracts.yield.oracle.actions.approve([ "foobar" ]).send("admin.yield@active");
+    const oracles = ["foobar", "myoracle"];
+    const owner = oracles[getProtocolSlot("myprotocol", 2)];
+    const other = oracles.find(oracle => oracle != owner);
+
+    // protocol is only updated by its assigned oracle
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    const action = contracts.yield.oracle.actions.updateall([other, 20]).send(`${other}@active`);
+    await expectToThrow(action, "eosio_assert: oracle::updateall: nothing to update");
+    await contracts.yield.oracle.actions.updateall([owner, 20]).send(`${owner}@active`);
+  });
+
+  it("updateall::failover", async () => {
+    const oracles = ["foobar", "myoracle"];
+    const owner = oracles[getProtocolSlot("myprotocol", 2)];
+    const other = oracles.find(oracle => oracle != owner);
+
+    // previous period missed, still within the grace window
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    blockchain.addTime(PERIOD_INTERVAL);
+    const action = contracts.yield.oracle.actions.updateall([other, 20]).send(`${other}@active`);
+    await expectToThrow(action, "eosio_assert: oracle::updateall: nothing to update");
+
+    // overdue by 30 minutes, open to every active oracle
+    blockchain.addTime(PERIOD_INTERVAL);
+    blockchain.addTime(PERIOD_INTERVAL);
+    const before = getPeriods("myprotocol").slice(-1)[0];
+    await contracts.yield.oracle.actions.updateall([other, 20]).send(`${other}@active`);
+    expect(getPeriods("myprotocol").slice(-1)[0].period).not.toEqual(before.period);
+
+    // re-activated protocol (never scheduled), grace window starts at the activation period
+    await contracts.yield.eosio.actions.deny([ "myprotocol" ]).send("admin.yield@active");
+    await contracts.yield.eosio.actions.approve([ "myprotocol" ]).send("admin.yield@active");
+    blockchain.addTime(PERIOD_INTERVAL);
+    blockchain.addTime(PERIOD_INTERVAL);
+    const action2 = contracts.yield.oracle.actions.updateall([other, 20]).send(`${other}@active`);
+    await expectToThrow(action2, "eosio_assert: oracle::updateall: nothing to update");
+    blockchain.addTime(PERIOD_INTERVAL);
+    blockchain.addTime(PERIOD_INTERVAL);
+    const reactivated = getPeriods("myprotocol").slice(-1)[0];
+    await contracts.yield.oracle.actions.updateall([other, 20]).send(`${other}@active`);
+    expect(getPeriods("myprotocol").slice(-1)[0].period).not.toEqual(reactivated.period);
+
+    // keep following specs on a single oracle
+    await contracts.yield.oracle.actions.deny([ "foobar" ]).send("admin.yield@active");
+  });
+
+  it("setskip::unchanged balances", async () => {
+    await contracts.yield.oracle.actions.setskip([true]).send();
+    expect(getConfig().skip_unchanged).toBe(true);
+
+    // first update stores balances & fingerprint
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    const first = getPeriods("myprotocol").slice(-1)[0];
+    expect(first.balances.length).toBeGreaterThan(0);
+    expect(first.balances_at).toEqual(first.period);
+    expect(getFingerprint("myprotocol").balances_at).toEqual(first.period);
+
+    // unchanged balances are stored as a compact marker
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    const second = getPeriods("myprotocol").slice(-1)[0];
+    expect(second.balances).toEqual([]);
+    expect(second.balances_at).toEqual(first.period);
+    expect(second.tvl).toEqual(first.tvl);
+
+    // balances referenced by the oldest period of the last 24 hours are kept
+    const now = TimePointSec.from(second.period).toMilliseconds() / 1000;
+    const interval = PERIOD_INTERVAL.value.toNumber();
+    const referenced = now - interval * 143;
+    setPeriod(referenced, referenced, referenced, first);
+    setPeriod(referenced + interval, referenced + interval, referenced, first);
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    expect(getPeriods("myprotocol").find(row => Number(row.key) == referenced)).toBeDefined();
+
+    // pruned once no longer referenced
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    expect(getPeriods("myprotocol").find(row => Number(row.key) == referenced)).toBeUndefined();
+
+    // fingerprints are erased once change detection is disabled
+    await contracts.yield.oracle.actions.setskip([false]).send();
+    expect(getFingerprint("myprotocol")).toBeUndefined();
+  });
+
+  it("balanceof::callback", async () => {
+    const token = "fa9343c3897324496a05fc75abed6bac29f8a40f";
+    const address = "671a5e209a5496256ee21386ec3eab9054d658a2";
+    setEvmToken(token, 201, 6, "4,USDT", { [address]: 663 });
+
+    // `balanceof` stores a pending request & appends its ID to the `exec` context
+    await contracts.yield.oracle.actions.balanceof([token, address]).send("oracle.yield@active");
+    const [ request ] = getRequests();
+    expect(request).toBeDefined();
+    const context = token + address + BigInt(request.request_id).toString(16).padStart(16, "0");
+
+    // `eosio.evm` sends the callback inline without authorization
+    const callback = contracts.yield.oracle.actions.callback([0, toWord(173151711000n), context]);
+    await callback.send("eosio.evm@active");
+    expect(getEvmBalance(201, 663).balance).toBe("173151.7110 USDT");
+    expect(getRequests()).toEqual([]);
+
+    // request is consumed (callbacks cannot be replayed)
+    await expectToThrow(callback.send("eosio.evm@active"), "eosio_assert: oracle::consume_evm_request: [request_id] request not found");
+  });
+
+  it("callback::error::request not found", async () => {
+    const context = "fa9343c3897324496a05fc75abed6bac29f8a40f" + "671a5e209a5496256ee21386ec3eab9054d658a2" + "0000000000000000";
+    const action = contracts.yield.oracle.actions.callback([0, toWord(1n), context]).send("myoracle@active");
+    await expectToThrow(action, "eosio_assert: oracle::consume_evm_request: [request_id] request not found");
+  });
+
+  it("balancesof::callbackall", async () => {
+    const token = "fa9343c3897324496a05fc75abed6bac29f8a40f";
+    const addresses = ["671a5e209a5496256ee21386ec3eab9054d658a2", "2f9ec37d6ccfff1cab21733bdadede11c823ccb0"];
+    setEvmToken(token, 201, 6, "4,USDT", { [addresses[0]]: 663, [addresses[1]]: 664 });
+    setMulticall("ca11bde05977b3631167028862be2a173976ca11"); // `setmulticall` requires an `eosio.evm` account
+
+    // `balancesof` stores a pending request & appends its ID to the `exec` context
+    await contracts.yield.oracle.actions.balancesof([addresses]).send("oracle.yield@active");
+    const [ request ] = getRequests();
+    expect(request).toBeDefined();
+    const context = token + addresses[0] + token + addresses[1] + BigInt(request.request_id).toString(16).padStart(16, "0");
+
+    // tryAggregate(false, calls) returns (bool success, bytes returnData)[]
+    const data = [
+      toWord(32n), // results offset
+      toWord(2n), // results length
+      toWord(64n), // result[0] offset
+      toWord(192n), // result[1] offset
+      toWord(1n), toWord(64n), toWord(32n), toWord(500000000n), // result[0] = (true, balanceOf)
+      toWord(0n), toWord(64n), toWord(0n), // result[1] = (false, "") reverted call
+    ].join("");
+
+    // `eosio.evm` sends the callback inline without authorization
+    const callbackall = contracts.yield.oracle.actions.callbackall([0, data, context]);
+    await callbackall.send("eosio.evm@active");
+    expect(getEvmBalance(201, 663).balance).toBe("500.0000 USDT");
+    expect(getEvmBalance(201, 664)).toBeUndefined(); // failed call keeps previous balance
+    expect(getRequests()).toEqual([]);
+
+    // request is consumed (callbacks cannot be replayed)
+    await expectToThrow(callbackall.send("eosio.evm@active"), "eosio_assert: oracle::consume_evm_request: [request_id] request not found");
+    setMulticall("");
+  });
+
+  it("callbackall::error::request not found", async () => {
+    const action = contracts.yield.oracle.actions.callbackall([0, toWord(32n) + toWord(0n), "0000000000000000"]).send("myoracle@active");
+    await expectToThrow(action, "eosio_assert: oracle::consume_evm_request: [request_id] request not found");
+  });
+
+  it("setmulticall::error::invalid address", async () => {
+    const action = contracts.yield.oracle.actions.setmulticall(["ca11bde0"]).send();
+    await expectToThrow(action, "eosio_assert: oracle::setmulticall: [multicall] must be 20 bytes");
+  });
+
+  it("setbudget", async () => {
+    await contracts.yield.oracle.actions.setbudget([30000]).send();
+    expect(getConfig().update_budget).toBe(30000);
+    await contracts.yield.oracle.actions.setbudget([0]).send();
+    expect(getConfig().update_budget).toBe(0);
+  });
+
+  it("settier", async () => {
+    await contracts.yield.oracle.actions.settier(["1000000.0000 EOS", 3600]).send();
+    expect(getConfig().tier_interval).toBe(3600);
+    expect(getConfig().tier_tvl).toBe("1000000.0000 EOS");
+    await contracts.yield.oracle.actions.settier(["0.0000 EOS", 0]).send();
+    expect(getConfig().tier_interval).toBe(0);
+  });
+
+  it("settier::error::invalid interval", async () => {
+    const action1 = contracts.yield.oracle.actions.settier(["1000000.0000 EOS", 900]).send();
+    await expectToThrow(action1, "eosio_assert: oracle::settier: [tier_interval] must be a multiple of 10 minutes");
+    const action2 = contracts.yield.oracle.actions.settier(["1000000.0000 EOS", 4200]).send();
+    await expectToThrow(action2, "eosio_assert: oracle::settier: [tier_interval] must divide 8 hours");
+  });
+
+  it("setreport", async () => {
+    await contracts.yield.oracle.actions.setreport([3600]).send();
+    expect(getConfig().report_interval).toBe(3600);
+
+    // tier interval must divide report interval
+    const action = contracts.yield.oracle.actions.settier(["1000000.0000 EOS", 2400]).send();
+    await expectToThrow(action, "eosio_assert: oracle::settier: [tier_interval] must divide [report_interval]");
+
+    await contracts.yield.oracle.actions.setreport([0]).send();
+    expect(getConfig().report_interval).toBe(0);
+  });
+
+  it("setreport::error::invalid interval", async () => {
+    const action1 = contracts.yield.oracle.actions.setreport([900]).send();
+    await expectToThrow(action1, "eosio_assert: oracle::setreport: [report_interval] must be a multiple of 10 minutes");
+    const action2 = contracts.yield.oracle.actions.setreport([4200]).send();
+    await expectToThrow(action2, "eosio_assert: oracle::setreport: [report_interval] must divide 8 hours");
+  });
+
+  it("calibrate", async () => {
+    await contracts.yield.oracle.actions.calibrate(["myoracle", "myprotocol", 800]).send("myoracle@active");
+    expect(getCost("myprotocol").cost).toBe(800);
+
+    // moving average of observed costs
+    await contracts.yield.oracle.actions.calibrate(["myoracle", "myprotocol", 1200]).send("myoracle@active");
+    expect(getCost("myprotocol").cost).toBe(900);
+  });
+
+  it("updateall::update budget", async () => {
+    await contracts.yield.eosio.actions.regprotocol(["protocol2", "dexes", metadata_oracle]).send('protocol2@active');
+    await contracts.yield.eosio.actions.approve(["protocol2"]).send("admin.yield@active");
+    await contracts.yield.oracle.actions.setbudget([1000]).send();
+    const protocols = ["myprotocol", "protocol2"];
+    const getLastPeriods = () => protocols.map(protocol => getPeriods(protocol).slice(-1)[0]?.period);
+    const before = getLastPeriods();
+
+    // budget is exceeded after the first protocol (myprotocol calibrated to 860us max, protocol2 estimated to 430us)
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    expect(getLastPeriods().filter((period, i) => period != before[i]).length).toEqual(1);
+
+    // next `updateall` resumes with the remaining protocol
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    expect(getLastPeriods().filter((period, i) => period != before[i]).length).toEqual(2);
+
+    await contracts.yield.oracle.actions.setbudget([0]).send();
+    await contracts.yield.eosio.actions.unregister(["protocol2"]).send('protocol2@active');
+  });
+
+  it("calibrate::error::missing required authority", async () => {
+    const action = contracts.yield.oracle.actions.calibrate(["myoracle", "myprotocol", 800]).send("foobar@active");
+    await expectToThrow(action, "missing required authority");
+  });
+
+  it("setstorage::ring buffer", async () => {
+    await contracts.yield.oracle.actions.setstorage([true]).send();
+    const config = getConfig();
+    expect(config.ring_buffer).toBe(true);
+
+    // periods stored before ring buffer are erased, medians are preserved
+    const before = getProtocol("myprotocol");
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    const periods = getPeriods("myprotocol");
+    expect(periods.length).toEqual(1);
+    expect(periods[0].key).toBeLessThan(144);
+    const after = getProtocol("myprotocol");
+    expect(after.period_at).not.toEqual(before.period_at);
+
+    // referenced balances are moved out of their overwritten slot, pruned once no longer referenced
+    const now = TimePointSec.from(periods[0].period).toMilliseconds() / 1000;
+    const interval = PERIOD_INTERVAL.value.toNumber();
+    const referenced = now + interval - 86400;
+    const slot = ( period: number ) => period / interval % 144;
+    setPeriod(slot(referenced), referenced, referenced, periods[0]);
+    setPeriod(slot(referenced + interval), referenced + interval, referenced, periods[0]);
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    expect(getPeriods("myprotocol").find(row => Number(row.key) == referenced)?.period).toEqual(TimePointSec.from(referenced).toString());
+
+    blockchain.addTime(PERIOD_INTERVAL); // push time by 10 minutes
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    expect(getPeriods("myprotocol").find(row => Number(row.key) == referenced)).toBeUndefined();
+  });
+
+  it("updateall::low TVL tier skipped off-boundary", async () => {
+    await contracts.yield.oracle.actions.settier(["1000000.0000 EOS", 3600]).send();
+    const hour = getNextHour(2);
+
+    // low TVL protocols are only sampled every `tier_interval`
+    blockchain.setTime(TimePointSec.from(hour - 600));
+    const action = contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    await expectToThrow(action, "eosio_assert: oracle::updateall: nothing to update");
+
+    blockchain.setTime(TimePointSec.from(hour));
+    await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    expect(getProtocol("myprotocol").period_at).toEqual(TimePointSec.from(hour).toString());
+    await contracts.yield.oracle.actions.settier(["0.0000 EOS", 0]).send();
+  });
+
+  it("report::scaled median minimum", async () => {
+    await contracts.yield.oracle.actions.settier(["350000.0000 EOS", 3600]).send();
+    await contracts.yield.eosio.actions.regprotocol(["protocol1", "dexes", metadata_oracle]).send('protocol1@active');
+    await contracts.yield.eosio.actions.approve(["protocol1"]).send("admin.yield@active");
+    const hour = getNextHour(1);
+
+    // hourly sampling requires 7 datapoints per bucket (6 in the oldest bucket)
+    setMedians("protocol1", hour, [6, 7, 6]);
+    blockchain.setTime(TimePointSec.from(hour));
+    await contracts.yield.oracle.actions.update(["myoracle", "protocol1"]).send();
+    expect(getProtocol("protocol1").period_at).toEqual("1970-01-01T00:00:00");
+
+    // 7 datapoints in every bucket (including the new datapoint)
+    setMedians("protocol1", hour + 3600, [7, 7, 6]);
+    blockchain.setTime(TimePointSec.from(hour + 3600));
+    await contracts.yield.oracle.actions.update(["myoracle", "protocol1"]).send();
+    expect(getProtocol("protocol1").period_at).toEqual(TimePointSec.from(hour + 3600).toString());
+  });
+
+  it("report::tier change", async () => {
+    // protocol moves above `tier_tvl` (sampled hourly, then every period)
+    await contracts.yield.oracle.actions.settier(["250000.0000 EOS", 3600]).send();
+    const hour = TimePointSec.from(getProtocol("protocol1").period_at).toMilliseconds() / 1000 + 3600;
+
+    // last 8 hours: 4 hourly datapoints followed by 4 hours sampled every period (28 datapoints including the new one)
+    const bucket_3 = [...getDatapoints(hour - 28800, 4, 3600), ...getDatapoints(hour - 14400, 23, 600)];
+    setMedians("protocol1", hour, [8, 8], 3600, bucket_3);
+    blockchain.setTime(TimePointSec.from(hour));
+    await contracts.yield.oracle.actions.update(["myoracle", "protocol1"]).send();
+    expect(getProtocol("protocol1").period_at).toEqual(TimePointSec.from(hour).toString());
+
+    // less than 7 hours covered (2 hourly datapoints followed by 4 hours sampled every period)
+    setMedians("protocol1", hour, [8, 8], 3600, [...getDatapoints(hour - 21600, 2, 3600), ...getDatapoints(hour - 14400, 23, 600)]);
+    blockchain.setTime(TimePointSec.from(hour + 600));
+    await contracts.yield.oracle.actions.update(["myoracle", "protocol1"]).send();
+    expect(getProtocol("protocol1").period_at).toEqual(TimePointSec.from(hour).toString());
+
+    await contracts.yield.oracle.actions.settier(["350000.0000 EOS", 3600]).send();
+  });
+
+  it("flushreports::grouped by interval", async () => {
+    const hour = TimePointSec.from(getProtocol("protocol1").period_at).toMilliseconds() / 1000 + 3600;
+    const period = TimePointSec.from(hour).toString();
+    blockchain.setTime(TimePointSec.from(hour));
+
+    // reports queued by `updateall` for protocols sampled at different intervals
+    const scope = Name.from('oracle.yield').value.value;
+    const tvl = "300000.0000 EOS";
+    const intervals: {[protocol: string]: number} = { myprotocol: 600, protocol1: 3600 };
+    for ( const [protocol, period_interval] of Object.entries(intervals) ) {
+      contracts.yield.oracle.tables.reports(scope).set(Name.from(protocol).value.value, Name.from("oracle.yield"), {
+        protocol, period, period_interval, tvl, usd: "416070.0000 USD",
+      });
+    }
+    const before = Object.keys(intervals).map(protocol => Asset.from(getProtocol(protocol).balance.quantity).units.toNumber());
+    await contracts.yield.oracle.actions.flushreports([]).send();
+    expect(contracts.yield.oracle.tables.reports(scope).getTableRows().length).toEqual(0);
+
+    // one `reportbatch` per interval, rewards of each protocol cover its own interval
+    Object.entries(intervals).forEach(([protocol, period_interval], i) => {
+      const after = getProtocol(protocol);
+      expect(after.period_at).toEqual(period);
+      expect(Asset.from(after.balance.quantity).units.toNumber()).toEqual(before[i] + calculateIntervalRewards(tvl, period_interval));
+    });
+
+    await contracts.yield.oracle.actions.settier(["0.0000 EOS", 0]).send();
+    await contracts.yield.eosio.actions.deny(["protocol1"]).send("admin.yield@active");
+  });
+
+  it("update::report once report interval elapsed", async () => {
+    await contracts.yield.oracle.actions.setreport([3600]).send();
+    const last = TimePointSec.from(getProtocol("myprotocol").period_at).toMilliseconds() / 1000;
+    const sample = async ( time: number ) => {
+      setMedians("myprotocol", time, [48, 48, 47], 600);
+      blockchain.setTime(TimePointSec.from(time));
+      await contracts.yield.oracle.actions.updateall(["myoracle", 20]).send("myoracle@active");
+    }
+
+    // samples between reports are not reported
+    await sample(last + 600);
+    expect(getProtocol("myprotocol").period_at).toEqual(TimePointSec.from(last).toString());
+
+    // first sample once the interval elapsed is reported
+    await sample(last + 3600);
+    expect(getProtocol("myprotocol").period_at).toEqual(TimePointSec.from(last + 3600).toString());
+
+    // missed sample (last + 7200), reported at the next sample instead of the next boundary
+    await sample(last + 7800);
+    expect(getProtocol("myprotocol").period_at).toEqual(TimePointSec.from(last + 7800).toString());
+
+    await contracts.yield.oracle.actions.setreport([0]).send();
+  });
+
   it("update::overflow checks", async () => {
     // 1B tokens EOS & USDT
     await contracts.token.EOS.actions.transfer(["eosio", "protocol3", "1000000000.0000 EOS", "init"]).send("eosio@active");
@@ -182,4 +821,50 @@ describe('oracle.yield', () => {
     await contracts.yield.eosio.actions.claim(["myprotocol", null]).send('myprotocol@active');
   });
 
+  it("migrate::legacy periods", async () => {
+    // period written before `periods.v2` (contracts & prices stored in each row)
+    const period = getProtocol("myprotocol").period_at;
+    const scope = Name.from("protocol2").value.value;
+    contracts.yield.oracle.tables.periods(scope).set(BigInt(TimePointSec.from(period).value.toNumber()), Name.from("oracle.yield"), {
+      period,
+      protocol: "protocol2",
+      category: "dexes",
+      contracts: ["protocol2"],
+      evm_contracts: [],
+      balances: ["1.0000 EOS"],
+      prices: ["1.3869 USD"],
+      tvl: "1.0000 EOS",
+      usd: "1.3869 USD",
+    });
+    expect(getLegacyPeriods("protocol2").length).toEqual(1);
+
+    await contracts.yield.oracle.actions.migrate(["protocol2", null]).send();
+    expect(getLegacyPeriods("protocol2")).toEqual([]);
+    const periods = getPeriods("protocol2");
+    expect(periods.length).toEqual(1);
+    expect(periods[0].period).toEqual(period);
+    expect(periods[0].balances).toEqual(["1.0000 EOS"]);
+    expect(periods[0].version).toEqual(getContracts("protocol2")[0].version);
+    expect(getContracts("protocol2")[0].contracts).toEqual(["protocol2"]);
+
+    const action = contracts.yield.oracle.actions.migrate(["protocol2", null]).send();
+    await expectToThrow(action, "eosio_assert: oracle::migrate: [protocol] has no legacy periods");
+
+    // legacy periods older than stored periods are not replayed
+    const older = TimePointSec.from(TimePointSec.from(period).value.toNumber() - PERIOD_INTERVAL.value.toNumber()).toString();
+    contracts.yield.oracle.tables.periods(scope).set(BigInt(TimePointSec.from(older).value.toNumber()), Name.from("oracle.yield"), {
+      period: older,
+      protocol: "protocol2",
+      category: "dexes",
+      contracts: ["protocol2"],
+      evm_contracts: [],
+      balances: ["1.0000 EOS"],
+      prices: ["1.3869 USD"],
+      tvl: "1.0000 EOS",
+      usd: "1.3869 USD",
+    });
+    const action2 = contracts.yield.oracle.actions.migrate(["protocol2", null]).send();
+    await expectToThrow(action2, "eosio_assert: oracle::migrate: [periods.v2] has periods newer than legacy periods");
+  });
+
 });
@@ -20,12 +20,40 @@ void oracle::cleartable( const name table_name, const optional<name> scope, cons
     oracle::config_table _config( get_self(), value );
     oracle::tokens_table _tokens( get_self(), value );
     oracle::periods_table _periods( get_self(), value );
+    oracle::legacy_periods_table _legacy_periods( get_self(), value );
+    oracle::prices_table _prices( get_self(), value );
+    oracle::medians_table _medians( get_self(), value );
+    oracle::contracts_table _contracts( get_self(), value );
+    oracle::holdings_table _holdings( get_self(), value );
+    oracle::reports_table _reports( get_self(), value );
+    oracle::scratch_table _scratch( get_self(), value );
+    oracle::cursors_table _cursors( get_self(), value );
+    oracle::costs_table _costs( get_self(), value );
+    oracle::fingerprints_table _fingerprints( get_self(), value );
+    oracle::requests_table _requests( get_self(), value );
+    oracle::snapshots_table _snapshots( get_self(), value );
+    oracle::evm_snapshots_table _evm_snapshots( get_self(), value );
+    oracle::state_table _state( get_self(), value );
     oracle::oracles_table _oracles( get_self(), value );
 
     if (table_name == "tokens"_n) clear_table( _tokens, rows_to_clear );
-    else if (table_name == "periods"_n) clear_table( _periods, rows_to_clear );
+    else if (table_name == "periods.v2"_n) clear_table( _periods, rows_to_clear );
+    else if (table_name == "periods"_n) clear_table( _legacy_periods, rows_to_clear );
+    else if (table_name == "prices"_n) clear_table( _prices, rows_to_clear );
+    else if (table_name == "medians"_n) clear_table( _medians, rows_to_clear );
+    else if (table_name == "contracts"_n) clear_table( _contracts, rows_to_clear );
+    else if (table_name == "holdings"_n) clear_table( _holdings, rows_to_clear );
+    else if (table_name == "reports"_n) clear_table( _reports, rows_to_clear );
+    else if (table_name == "scratch"_n) clear_table( _scratch, rows_to_clear );
+    else if (table_name == "cursors"_n) clear_table( _cursors, rows_to_clear );
+    else if (table_name == "costs"_n) clear_table( _costs, rows_to_clear );
+    else if (table_name == "fingerprints"_n) clear_table( _fingerprints, rows_to_clear );
+    else if (table_name == "requests"_n) clear_table( _requests, rows_to_clear );
+    else if (table_name == "snapshots"_n) clear_table( _snapshots, rows_to_clear );
+    else if (table_name == "evm.snapshots"_n) clear_table( _evm_snapshots, rows_to_clear );
     else if (table_name == "oracles"_n) clear_table( _oracles, rows_to_clear );
     else if (table_name == "config"_n) _config.remove();
+    else if (table_name == "state"_n) _state.remove();
     else check(false, "oracle::cleartable: [table_name] unknown table to clear" );
 }
 
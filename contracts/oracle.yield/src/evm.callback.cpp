@@ -1,9 +1,45 @@
+// powers of ten (10^0 .. 10^19) that fit in uint64
+static constexpr array<uint64_t, 20> POW10_UINT64 = []() {
+    array<uint64_t, 20> table{};
+    table[0] = 1;
+    for ( size_t i = 1; i < table.size(); ++i ) table[i] = table[i - 1] * 10;
+    return table;
+}();
+
+// powers of ten (10^0 .. 10^77) that fit in uint256
+static constexpr array<intx::uint256, 78> POW10_UINT256 = []() {
+    array<intx::uint256, 78> table{};
+    table[0] = 1;
+    for ( size_t i = 1; i < table.size(); ++i ) table[i] = table[i - 1] * 10;
+    return table;
+}();
+
+// reduce precision by 10^decimals (rounded half up & saturated to int64)
 int64_t oracle::bytes_to_int64( const bytes data, const uint8_t decimals )
 {
     eosio::check(data.size() == 32, "bytes_to_int64: wrong length");
-    auto v = intx::be::unsafe::load<intx::uint256>(data.data()) / pow(10, decimals); // reduce precision
-    eosio::check(v <= numeric_limits<int64_t>::max(), "bytes_to_int64: out of range");
-    return int64_t(v);
+    eosio::check(decimals < POW10_UINT256.size(), "bytes_to_int64: [decimals] out of range");
+    const uint64_t max = numeric_limits<int64_t>::max();
+
+    // fast path when upper 192 bits are zero
+    if ( all_of(data.begin(), data.begin() + 24, []( const uint8_t byte ) { return byte == 0; }) ) {
+        uint64_t value = 0;
+        for ( size_t i = 24; i < 32; ++i ) value = (value << 8) | data[i];
+        if ( decimals >= POW10_UINT64.size() ) return 0; // uint64 < 10^20 / 2
+
+        const uint64_t divisor = POW10_UINT64[decimals];
+        const uint64_t remainder = value % divisor;
+        const uint64_t quotient = value / divisor + (remainder >= divisor - remainder ? 1 : 0);
+        return int64_t(min(quotient, max));
+    }
+
+    const auto value = intx::be::unsafe::load<intx::uint256>(data.data());
+    const auto divisor = POW10_UINT256[decimals];
+    const auto result = intx::udivrem(value, divisor);
+    auto quotient = result.quot;
+    if ( result.rem >= divisor - result.rem ) quotient += 1;
+    if ( quotient > max ) return int64_t(max);
+    return int64_t(quotient);
 }
 
 // @callback
@@ -11,26 +47,28 @@ int64_t oracle::bytes_to_int64( const bytes data, const uint8_t decimals )
 void oracle::callback( const int32_t status, const bytes data, const std::optional<bytes> context )
 {
     check(get_first_receiver() == get_self(), "callback must initially be called by this contract");
+    check(context.has_value(), "oracle::callback: [context] is required");
+
+    // sent inline by `eosio.evm` without authorization (only pending requests are accepted)
+    const bytes call = consume_evm_request( *context );
+    check(call.size() == 40, "oracle::callback: [context] must be 40 bytes");
 
     oracle::evm_tokens_table _evm_tokens( get_self(), get_self().value );
 
-    const string context_str = silkworm::to_hex(*context, false);
-    const bytes contract = *silkworm::from_hex(context_str.substr(0, 40));
-    const bytes address = *silkworm::from_hex(context_str.substr(40, 40));
+    // context = contract + address
+    const bytes contract( call.begin(), call.begin() + 20 );
+    const bytes address( call.begin() + 20, call.end() );
 
-    // token amount from `balanceof` call
-    const uint64_t token_id = evm_contract::get_account_id( contract );
-    const uint64_t address_id = evm_contract::get_account_id( address );
-    const auto token = _evm_tokens.find( token_id);
+    const uint64_t token_id = get_evm_account_id( contract );
+    const auto token = _evm_tokens.find( token_id );
     check(token != _evm_tokens.end(), "oracle::callback: [token_id=" + to_string(token_id) + " & contract=" + silkworm::to_hex(contract, true) + "] token not found" );
 
     // token amount from `balanceof` call
     const uint8_t decimals = token->decimals - token->sym.precision();
     const int64_t amount = bytes_to_int64(data, decimals);
 
-    // send inline action to update current balance
-    setbalance_action setbalance{ get_self(), { get_self(), "active"_n } };
-    setbalance.send( contract, address, asset{amount, token->sym} );
+    // update current balance
+    set_evm_balance( token_id, address, asset{amount, token->sym} );
 }
 
 // @system update
@@ -57,7 +95,7 @@ void oracle::balanceof( const bytes contract, const bytes address )
     bytes context; // contract + address
     context.insert(context.end(), contract.begin(), contract.end());
     context.insert(context.end(), address.begin(), address.end());
-    input.context = context;
+    input.context = add_evm_request( context );
 
     // Callback
     evm_contract::exec_callback callback;
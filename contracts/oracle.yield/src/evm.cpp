@@ -6,10 +6,9 @@ void oracle::addevmtoken( const bytes address, const uint8_t decimals, const sym
 
     oracle::tokens_table _tokens( get_self(), get_self().value );
     oracle::evm_tokens_table _evm_tokens( get_self(), get_self().value );
-    evm_contract::account_table _account( get_self(), get_self().value );
 
     // validate
-    const uint64_t account_id = evm_contract::get_account_id(address);
+    const uint64_t account_id = get_evm_account_id(address);
 
     if (!is_stable(sym)) {
         const auto token = _tokens.get( sym.code().raw(), "oracle::addevmtoken: [sym] token not found" );
@@ -36,7 +35,7 @@ void oracle::delevmtoken( const bytes address )
 {
     require_auth( get_self() );
 
-    const uint64_t token_id = evm_contract::get_account_id( address );
+    const uint64_t token_id = get_evm_account_id( address );
     oracle::evm_tokens_table _evm_tokens( get_self(), get_self().value );
     auto & itr = _evm_tokens.get( token_id, "oracle::delevmtoken: [address] does not exists" );
     _evm_tokens.erase( itr );
@@ -52,11 +51,17 @@ void oracle::setbalance( const bytes contract, const bytes address, const asset
     oracle::evm_tokens_table _evm_tokens( get_self(), get_self().value );
 
     // validate
-    const uint64_t token_id = evm_contract::get_account_id(contract);
-    const uint64_t address_id = evm_contract::get_account_id(address);
+    const uint64_t token_id = get_evm_account_id(contract);
     _evm_tokens.get( token_id, "oracle::setbalance: [token_id] token not found" );
 
-    // add supported token
+    set_evm_balance( token_id, address, balance );
+}
+
+void oracle::set_evm_balance( const uint64_t token_id, const bytes address, const asset balance )
+{
+    const uint64_t address_id = get_evm_account_id(address);
+
+    // add token balance
     auto insert = [&]( auto& row ) {
         row.address_id = address_id;
         row.address = address;
@@ -70,13 +75,82 @@ void oracle::setbalance( const bytes contract, const bytes address, const asset
     else _evm_balances.modify( itr, get_self(), insert );
 }
 
-asset oracle::get_evm_balance_quantity(const uint64_t token_id, const string evm_contract, const symbol sym )
+// returns empty if balance symbol does not match
+optional<asset> oracle::find_evm_balance_quantity( const uint64_t token_id, const uint64_t address_id, const symbol sym )
 {
     oracle::evm_balances_table _evm_balances( get_self(), token_id );
-    const uint64_t address_id = evm_contract::get_account_id( *silkworm::from_hex(evm_contract) );
 
     const auto itr = _evm_balances.find( address_id );
-    if ( itr == _evm_balances.end() ) return { 0, sym };
-    check( itr->balance.symbol == sym, "oracle::get_evm_balance_quantity: [sym] does not match");
+    if ( itr == _evm_balances.end() ) return asset{ 0, sym };
+    if ( itr->balance.symbol != sym ) return {};
     return itr->balance;
-}
\ No newline at end of file
+}
+
+uint64_t oracle::get_evm_account_id( const bytes& address )
+{
+    const optional<uint64_t> account_id = find_evm_account_id( address );
+    check( account_id.has_value(), "oracle::get_evm_account_id: [address=" + silkworm::to_hex( address, true ) + "] account not found");
+    return *account_id;
+}
+
+// returns empty if address is not an `eosio.evm` account
+optional<uint64_t> oracle::find_evm_account_id( const bytes& address )
+{
+    oracle::evm_accounts_table _evm_accounts( get_self(), get_self().value );
+
+    // key by first 8 bytes of address (uniformly distributed)
+    uint64_t key = 0;
+    for ( size_t i = 0; i < 8 && i < address.size(); ++i ) key = (key << 8) | address[i];
+
+    // cached
+    auto itr = _evm_accounts.find( key );
+    if ( itr != _evm_accounts.end() && itr->address == address ) return itr->account_id;
+
+    // resolve from `eosio.evm` (only cache when key is not used by another address)
+    evm_contract::account_table _account( "eosio.evm"_n, "eosio.evm"_n.value );
+    auto idx = _account.get_index<"by.address"_n>();
+    auto account_itr = idx.find( make_key( address ) );
+    if ( account_itr == idx.end() ) return {};
+    const uint64_t account_id = account_itr->id;
+    if ( itr == _evm_accounts.end() ) {
+        _evm_accounts.emplace( get_self(), [&]( auto& row ) {
+            row.key = key;
+            row.address = address;
+            row.account_id = account_id;
+        });
+    }
+    return account_id;
+}
+
+// stores a pending request & returns the callback context (context + request ID)
+bytes oracle::add_evm_request( const bytes& context )
+{
+    oracle::requests_table _requests( get_self(), get_self().value );
+
+    const uint64_t request_id = _requests.available_primary_key();
+    _requests.emplace( get_self(), [&]( auto& row ) {
+        row.request_id = request_id;
+        row.hash = sha256( (const char*) context.data(), context.size() );
+        row.requested_at = current_time_point();
+    });
+
+    bytes request = context;
+    for ( int i = 7; i >= 0; --i ) request.push_back( uint8_t(request_id >> (i * 8)) );
+    return request;
+}
+
+// erases the pending request of a callback context & returns the original context
+bytes oracle::consume_evm_request( const bytes& request )
+{
+    check(request.size() >= 8, "oracle::consume_evm_request: [context] is missing request ID");
+
+    uint64_t request_id = 0;
+    for ( size_t i = request.size() - 8; i < request.size(); ++i ) request_id = (request_id << 8) | request[i];
+    const bytes context( request.begin(), request.end() - 8 );
+
+    oracle::requests_table _requests( get_self(), get_self().value );
+    const auto& itr = _requests.get( request_id, "oracle::consume_evm_request: [request_id] request not found" );
+    check(itr.hash == sha256( (const char*) context.data(), context.size() ), "oracle::consume_evm_request: [context] does not match request");
+    _requests.erase( itr );
+    return context;
+}
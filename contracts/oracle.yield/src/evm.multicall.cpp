@@ -0,0 +1,130 @@
+void oracle::append_abi_word( bytes& data, const uint64_t value )
+{
+    data.insert(data.end(), 24, 0);
+    for ( int i = 7; i >= 0; --i ) data.push_back( uint8_t(value >> (i * 8)) );
+}
+
+void oracle::append_abi_address( bytes& data, const bytes& address )
+{
+    check(address.size() == 20, "oracle::append_abi_address: [address] must be 20 bytes");
+    data.insert(data.end(), 12, 0);
+    data.insert(data.end(), address.begin(), address.end());
+}
+
+uint64_t oracle::read_abi_word( const bytes& data, const uint64_t position )
+{
+    check(position <= data.size() && data.size() - position >= 32, "oracle::read_abi_word: out of range");
+
+    uint64_t value = 0;
+    for ( uint64_t i = 0; i < 24; ++i ) check(data[position + i] == 0, "oracle::read_abi_word: value too large");
+    for ( uint64_t i = 24; i < 32; ++i ) value = (value << 8) | data[position + i];
+
+    // every word read is either a boolean, a length or an offset within `data`
+    check(value <= data.size(), "oracle::read_abi_word: value too large");
+    return value;
+}
+
+// @callback
+[[eosio::action]]
+void oracle::callbackall( const int32_t status, const bytes data, const std::optional<bytes> context )
+{
+    check(get_first_receiver() == get_self(), "callbackall must initially be called by this contract");
+    check(context.has_value(), "oracle::callbackall: [context] is required");
+
+    // sent inline by `eosio.evm` without authorization (only pending requests are accepted)
+    // context = (token contract + address) for each call
+    const bytes calls = consume_evm_request( *context );
+
+    // failed multicall keeps previous balances (does not abort `updateall`)
+    if ( status != 0 ) {
+        oracle::evmerrorlog_action evmerrorlog( get_self(), { get_self(), "active"_n });
+        evmerrorlog.send( status, calls );
+        return;
+    }
+
+    oracle::evm_tokens_table _evm_tokens( get_self(), get_self().value );
+
+    // returns (bool success, bytes returnData)[]
+    const uint64_t results = read_abi_word( data, 0 );
+    const uint64_t size = read_abi_word( data, results );
+    check(size * 40 == calls.size(), "oracle::callbackall: [context] does not match results");
+
+    for ( uint64_t i = 0; i < size; ++i ) {
+        const uint64_t result = results + 32 + read_abi_word( data, results + 32 + i * 32 );
+        const bool success = read_abi_word( data, result ) != 0;
+        const uint64_t offset = result + read_abi_word( data, result + 32 );
+        const uint64_t length = read_abi_word( data, offset );
+        if ( !success || length != 32 ) continue; // keep previous balance
+        if ( data.size() - offset < 64 ) continue; // truncated return data (`offset + 32 <= data.size()` checked by `read_abi_word`)
+
+        const bytes contract( calls.begin() + i * 40, calls.begin() + i * 40 + 20 );
+        const bytes address( calls.begin() + i * 40 + 20, calls.begin() + i * 40 + 40 );
+        const auto token = _evm_tokens.find( get_evm_account_id( contract ) );
+        if ( token == _evm_tokens.end() ) continue; // token removed since `balancesof`
+
+        // token amount from `balanceOf` call
+        const bytes value( data.begin() + offset + 32, data.begin() + offset + 64 );
+        const uint8_t decimals = token->decimals - token->sym.precision();
+        set_evm_balance( token->token_id, address, asset{ bytes_to_int64(value, decimals), token->sym } );
+    }
+}
+
+// @system update
+[[eosio::action]]
+void oracle::balancesof( const vector<bytes> addresses )
+{
+    require_auth( get_self() );
+
+    const bytes multicall = get_config().multicall.value();
+    check( multicall.size(), "oracle::balancesof: [multicall] is not configured");
+
+    oracle::evm_tokens_table _evm_tokens( get_self(), get_self().value );
+
+    // balanceOf each address for each supported token
+    vector<pair<bytes, bytes>> calls;
+    for ( const bytes& address : addresses ) {
+        for ( const auto evm_token : _evm_tokens ) {
+            calls.push_back({ evm_token.address, address });
+        }
+    }
+    const uint64_t size = calls.size();
+    check( size, "oracle::balancesof: nothing to read");
+
+    // tryAggregate(false, calls)
+    bytes data = *silkworm::from_hex("bce38bd7"); // sha3(tryAggregate(bool,(address,bytes)[]))[:4]
+    append_abi_word( data, 0 ); // requireSuccess
+    append_abi_word( data, 64 ); // calls offset
+    append_abi_word( data, size ); // calls length
+
+    // each call (address target, bytes callData) is encoded in 160 bytes
+    for ( uint64_t i = 0; i < size; ++i ) append_abi_word( data, size * 32 + i * 160 );
+
+    bytes context; // (contract + address) for each call
+    const bytes method = *silkworm::from_hex("70a08231"); // sha3(balanceOf(address))[:4]
+    for ( const auto& [contract, address] : calls ) {
+        append_abi_address( data, contract );
+        append_abi_word( data, 64 ); // callData offset
+        append_abi_word( data, 36 ); // callData length
+        data.insert(data.end(), method.begin(), method.end());
+        append_abi_address( data, address );
+        data.insert(data.end(), 28, 0); // pad callData to 64 bytes
+
+        context.insert(context.end(), contract.begin(), contract.end());
+        context.insert(context.end(), address.begin(), address.end());
+    }
+
+    // Inputs
+    evm_contract::exec_input input;
+    input.data = data;
+    input.to = multicall;
+    input.context = add_evm_request( context );
+
+    // Callback
+    evm_contract::exec_callback callback;
+    callback.contract = get_self();
+    callback.action = "callbackall"_n;
+
+    // Push transaction
+    evm_contract::exec_action exec{ "eosio.evm"_n, { get_self(), "active"_n } };
+    exec.send( input, callback );
+}
@@ -10,9 +10,29 @@ void oracle::on_transfer( const name from, const name to, const asset quantity,
     notify_admin();
 }
 
+// protocol unregistered from Yield+
+[[eosio::on_notify("*::eraselog")]]
+void oracle::on_eraselog( const name protocol )
+{
+    oracle::config_table _config( get_self(), get_self().value );
+    if ( !_config.exists() || get_first_receiver() != _config.get().yield_contract ) return;
+
+    oracle::fingerprints_table _fingerprints( get_self(), get_self().value );
+    auto itr = _fingerprints.find( protocol.value );
+    if ( itr != _fingerprints.end() ) _fingerprints.erase( itr );
+}
+
 // @eosio.code
 [[eosio::action]]
-void oracle::updatelog( const name oracle, const name protocol, const name category, const set<name> contracts, const set<string> evm, const time_point_sec period, const vector<asset> balances, const vector<asset> prices, const asset tvl, const asset usd )
+void oracle::updatelog( const name oracle, const name protocol, const name category, const set<name> contracts, const set<checksum160> evm, const time_point_sec period, const vector<asset> balances, const vector<asset> prices, const asset tvl, const asset usd )
+{
+    require_auth( get_self() );
+    notify_admin();
+}
+
+// @eosio.code
+[[eosio::action]]
+void oracle::unchangedlog( const name oracle, const name protocol, const time_point_sec period, const time_point_sec balances_at, const asset tvl, const asset usd )
 {
     require_auth( get_self() );
     notify_admin();
@@ -66,3 +86,19 @@ void oracle::rewardslog( const name oracle, const asset rewards, const asset bal
     require_auth( get_self() );
     notify_admin();
 }
+
+// @eosio.code
+[[eosio::action]]
+void oracle::evmerrorlog( const int32_t status, const bytes context )
+{
+    require_auth( get_self() );
+    notify_admin();
+}
+
+// @eosio.code
+[[eosio::action]]
+void oracle::skiplog( const name oracle, const time_point_sec period, const uint16_t updated, const map<name, name> skipped )
+{
+    require_auth( get_self() );
+    notify_admin();
+}
@@ -71,9 +71,22 @@ public:
 
         auto idx = _account.get_index<"by.address"_n>();
         auto it = idx.find(make_key(address));
-        auto itr = _account.find( it->id );
         check( it != idx.end(), "evm_contract::get_account_id: [address=" + silkworm::to_hex(address, true) + "] account not found" );
-        return itr->id;
+        return it->id;
+    }
+
+    static checksum160 to_address( const bytes& address )
+    {
+        check( address.size() == 20, "evm_contract::to_address: [address] must be 20 bytes" );
+        std::array<uint8_t, 20> data;
+        std::copy( address.begin(), address.end(), data.begin() );
+        return checksum160( data );
+    }
+
+    static bytes to_bytes( const checksum160& address )
+    {
+        const auto data = address.extract_as_byte_array();
+        return bytes( data.begin(), data.end() );
     }
 
     static bool is_account( const bytes address )
@@ -82,7 +95,6 @@ public:
 
         auto idx = _account.get_index<"by.address"_n>();
         auto it = idx.find(make_key(address));
-        auto itr = _account.find( it->id );
         return it != idx.end();
     }
 };
\ No newline at end of file
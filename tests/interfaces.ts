@@ -14,17 +14,54 @@ export interface ExtendedSymbol {
 }
 
 export interface Period {
+    key: number;
+    period: Date;
+    version: number;
+    balances: string[];
+    tvl: string;
+    usd: string;
+    balances_at: string;
+};
+
+export interface LegacyPeriod {
     period: Date;
     protocol: string;
     category: string;
     contracts: string[];
-    evm: any[];
-    balances: any[];
-    prices: any[];
+    evm_contracts: string[];
+    balances: string[];
+    prices: string[];
     tvl: string;
     usd: string;
 };
 
+export interface Contracts {
+    version: number;
+    period: Date;
+    category: string;
+    contracts: string[];
+    evm_contracts: string[];
+};
+
+export interface Price {
+    period: Date;
+    sym: string;
+    price: string;
+};
+
+export interface Datapoint {
+    period: Date;
+    tvl: number;
+    usd: number;
+};
+
+export interface Median {
+    protocol: string;
+    bucket_1: Datapoint[];
+    bucket_2: Datapoint[];
+    bucket_3: Datapoint[];
+};
+
 export interface Metakey {
     key: string; //  "category"
     required: boolean; // true
@@ -45,6 +82,21 @@ export interface Protocol {
   tvl: string; //  "200000.0000 EOS"
   usd: string; //  "300000.0000 USD"
   balance: ExtendedAsset; //  {"quantity": "2.5000 EOS", "contract": "eosio.token"}
+  period_at: string; //  "1970-01-01T00:00:00"
+  epoch: string; //  "2022-05-13T00:00:00"
+  accrued: string; //  "0.0600 EOS"
+  accrued_interval: number; //  3600
+}
+
+export interface LegacyProtocol {
+  protocol: string; //  "myprotocol"
+  status: string; //  "active"
+  category: string; //  "dexes"
+  contracts: string[]; //  ["myprotocol", "mytreasury"]
+  evm_contracts: string[]; //  ["0x2f9ec37d6ccfff1cab21733bdadede11c823ccb0"]
+  tvl: string; //  "200000.0000 EOS"
+  usd: string; //  "300000.0000 USD"
+  balance: ExtendedAsset; //  {"quantity": "2.5000 EOS", "contract": "eosio.token"}
   metadata: KV[]; //  [{"key": "website", "value": "https://myprotocol.com"}]
   created_at: string; //  "2022-05-13T00:00:00"
   updated_at: string; //  "2022-05-13T00:00:00"
@@ -52,6 +104,19 @@ export interface Protocol {
   period_at: string; //  "1970-01-01T00:00:00"
 }
 
+export interface Metadata {
+  protocol: string; //  "myprotocol"
+  metadata: KV[]; //  [{"key": "website", "value": "https://myprotocol.com"}]
+  created_at: string; //  "2022-05-13T00:00:00"
+  updated_at: string; //  "2022-05-13T00:00:00"
+  claimed_at: string; //  "1970-01-01T00:00:00"
+}
+
+export interface Active {
+  protocol: string; //  "myprotocol"
+  due_at: string; //  "2022-05-13T00:10:00"
+}
+
 export interface YieldConfig {
   annual_rate: number; // 500
   min_tvl_report: string; // "200000.0000 EOS"
@@ -59,6 +124,7 @@ export interface YieldConfig {
   rewards: ExtendedSymbol; // { "sym": "4,EOS", "contract": "eosio.token" }
   oracle_contract: string; // "oracle.yield"
   admin_contract: string; // "admin.yield"
+  epoch_interval: number; // 0
 }
 
 export interface Oracle {
@@ -71,8 +137,72 @@ export interface Oracle {
   claimed_at: Date;
 }
 
+export interface OracleState {
+  tokens_at: string;
+  batch_reports: boolean;
+}
+
+export interface Cursor {
+  oracle: string;
+  protocol: string;
+  due_at: string;
+  period: string;
+}
+
+export interface Scratch {
+  protocol: string;
+  period: string;
+  contracts: string[];
+  evm_contracts: string[];
+  cursor: number;
+  balances: string[];
+  prices: string[];
+}
+
+export interface Holdings {
+  contract: string;
+  tokens: ExtendedSymbol[];
+  refreshed_at: string;
+}
+
 export interface OracleConfig {
   reward_per_update: ExtendedAsset;
   yield_contract: string;
   admin_contract: string;
+  ring_buffer: boolean;
+  multicall: string;
+  update_budget: number;
+  tier_tvl: string;
+  tier_interval: number;
+  report_interval: number;
+  skip_unchanged: boolean;
+}
+
+export interface Cost {
+  protocol: string;
+  cost: number;
+  calibrated_at: string;
+}
+
+export interface Request {
+  request_id: number;
+  hash: string;
+  requested_at: string;
+}
+
+export interface Snapshot {
+  period: string;
+  balances: string[];
+}
+
+export interface EvmBalance {
+  address_id: number;
+  address: string;
+  balance: string;
+}
+
+export interface Fingerprint {
+  protocol: string;
+  balances_at: string;
+  fingerprint: string;
 }